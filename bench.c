@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "utils.h"
+#include "blocklist.h"
+#include "history.h"
+
+#define MIN_TIME_NS		200000000	/* run each benchmark for at least 0.2 s */
+#define HISTORY_LINES	100000
+#define BOOKMARK_LINES	10000
+#define COMMAND_WORDS	512
+#define BLOCK_HOSTS		50000
+#define BLOCK_FILTERS	20000
+
+typedef struct _Benchmark Benchmark;
+
+struct _Benchmark {
+	char *name;
+	void (*func)(void);
+};
+
+/* allocation counters, see the --wrap linker flags in the Makefile */
+static unsigned long allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+char *__real_strdup(const char *s);
+
+void *__wrap_malloc(size_t size)
+{
+	allocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	allocs++;
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	allocs++;
+	return __real_realloc(ptr, size);
+}
+
+char *__wrap_strdup(const char *s)
+{
+	allocs++;
+	return __real_strdup(s);
+}
+
+/* synthetic inputs */
+static char *command_line;
+static char **command_tokens;
+static char *history_file;
+static char *history_records_file;
+static char *bookmarks_file;
+static History *history;
+static History *history_full;
+static unsigned long history_oldest;
+static unsigned long history_new_uris;
+static Blocklist *blocklist;
+
+static void bench_tokenize(void)
+{
+	strfreev(tokenize(command_line, " "));
+}
+
+static void bench_strjoinv(void)
+{
+	free(strjoinv(command_tokens, " "));
+}
+
+static void bench_strconcat(void)
+{
+	free(strconcat("https://www.example.com", "/", command_tokens[0], " [",
+				"-+", "]", NULL));
+}
+
+static void bench_strappend(void)
+{
+	char *str = NULL;
+	int i;
+
+	for (i = 0; i < 64; i++) {
+		str = strappend(str, "0123456789abcdef");
+	}
+	free(str);
+}
+
+static void free_list(GList *list)
+{
+	GList *l;
+
+	for (l = list; l; l = g_list_next(l)) {
+		free(l->data);
+	}
+	g_list_free(list);
+}
+
+static void bench_read_history(void)
+{
+	free_list(read_file(history_file, NULL));
+}
+
+static void bench_read_bookmarks(void)
+{
+	free_list(g_list_reverse(read_file(bookmarks_file, NULL)));
+}
+
+static void read_history_file(char *filename)
+{
+	History *h = history_new(0, 0);
+	gboolean legacy;
+
+	history_read_file(h, filename, &legacy);
+	history_free(h);
+}
+
+static void bench_read_history_flat(void)
+{
+	read_history_file(history_file);
+}
+
+static void bench_read_history_records(void)
+{
+	read_history_file(history_records_file);
+}
+
+/* history_add() for the least recently visited uri */
+static void bench_history_revisit(void)
+{
+	char uri[64];
+	unsigned long i = history_oldest++ % HISTORY_LINES;
+
+	snprintf(uri, sizeof uri, "https://www.example.com/%lu/page-%lu.html", i, i);
+	history_visit(history, uri, NULL, 0);
+}
+
+/* history_add() for a new uri at the limit, evicting the oldest */
+static void bench_history_evict(void)
+{
+	char uri[64];
+
+	snprintf(uri, sizeof uri, "https://www.example.net/new/%lu", history_new_uris++);
+	history_visit(history_full, uri, NULL, 0);
+}
+
+/* a subresource no rule matches, the common case */
+static void bench_blocklist_pass(void)
+{
+	blocklist_match(blocklist, "https://cdn.example.com/assets/js/app.min.js?v=20160412");
+}
+
+static void bench_blocklist_block(void)
+{
+	blocklist_match(blocklist, "https://static.tracker4242.example.net/pixel.gif?id=1");
+}
+
+static Benchmark benchmarks[] = {
+	{ "tokenize (command line)",	bench_tokenize },
+	{ "strjoinv (command line)",	bench_strjoinv },
+	{ "strconcat (6 strings)",		bench_strconcat },
+	{ "strappend (64 appends)",		bench_strappend },
+	{ "read_file (history)",		bench_read_history },
+	{ "read_file (bookmarks)",		bench_read_bookmarks },
+	{ "history read (flat)",		bench_read_history_flat },
+	{ "history read (records)",		bench_read_history_records },
+	{ "history add (revisit oldest)",	bench_history_revisit },
+	{ "history add (evict oldest)",	bench_history_evict },
+	{ "blocklist match (pass)",		bench_blocklist_pass },
+	{ "blocklist match (block)",	bench_blocklist_block },
+};
+
+static gint64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (gint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void run(Benchmark *bm)
+{
+	unsigned long n, i, start_allocs;
+	gint64 start, elapsed;
+
+	/* double the iterations until the minimum time is reached */
+	for (n = 1; ; n *= 2) {
+		start_allocs = allocs;
+		start = now_ns();
+		for (i = 0; i < n; i++) {
+			bm->func();
+		}
+		elapsed = now_ns() - start;
+
+		if (elapsed >= MIN_TIME_NS) {
+			break;
+		}
+	}
+
+	printf("%-32s %10lu %14.1f %12.1f\n", bm->name, n,
+			(double)elapsed / n, (double)(allocs - start_allocs) / n);
+}
+
+/*
+ * write a temporary file of lines generated by fmt (which takes the line
+ * number twice)
+ *
+ * Return: dynamically allocated file name
+ */
+static char *write_tmp_file(char *fmt, int lines)
+{
+	char *filename;
+	FILE *fp;
+	int fd, i;
+
+	fd = g_file_open_tmp("ripcurl-bench-XXXXXX", &filename, NULL);
+	if (fd == -1 || !(fp = fdopen(fd, "w"))) {
+		die("unable to create temporary file\n");
+	}
+
+	for (i = 0; i < lines; i++) {
+		fprintf(fp, fmt, i, i);
+	}
+
+	fclose(fp);
+
+	return filename;
+}
+
+static void setup(void)
+{
+	char **words, *rule;
+	GString *data;
+	gboolean legacy;
+	int i, fd;
+
+	/* long command line - ":open" followed by many search terms */
+	words = emalloc((COMMAND_WORDS + 1) * sizeof *words);
+	for (i = 0; i < COMMAND_WORDS; i++) {
+		asprintf(&words[i], "term%d", i);
+	}
+	words[i] = NULL;
+	command_line = strjoinv(words, " ");
+	strfreev(words);
+
+	command_tokens = tokenize(command_line, " ");
+
+	/* history and bookmarks files of realistic size */
+	history_file = write_tmp_file("https://www.example.com/%d/page-%d.html\n", HISTORY_LINES);
+	bookmarks_file = write_tmp_file("https://www.example.org/bookmark/%d tag%d work\n", BOOKMARK_LINES);
+
+	/* unbounded, and full at the limit */
+	history = history_new(0, 0);
+	history_read_file(history, history_file, &legacy);
+	history_full = history_new(HISTORY_LINES, 0);
+	history_read_file(history_full, history_file, &legacy);
+
+	/* the same history in the record format */
+	data = history_serialize(history);
+	fd = g_file_open_tmp("ripcurl-bench-XXXXXX", &history_records_file, NULL);
+	if (fd == -1 || write(fd, data->str, data->len) != (ssize_t)data->len) {
+		die("unable to write temporary file\n");
+	}
+	close(fd);
+	g_string_free(data, TRUE);
+
+	/* blocklist of EasyList size, hosts and url filters */
+	blocklist = blocklist_new();
+	for (i = 0; i < BLOCK_HOSTS; i++) {
+		asprintf(&rule, "||tracker%d.example.net^", i);
+		blocklist_add_rule(blocklist, rule);
+		free(rule);
+	}
+	for (i = 0; i < BLOCK_FILTERS; i++) {
+		asprintf(&rule, "/banner%d/*$image,third-party", i);
+		blocklist_add_rule(blocklist, rule);
+		free(rule);
+	}
+}
+
+static void teardown(void)
+{
+	unlink(history_file);
+	unlink(history_records_file);
+	unlink(bookmarks_file);
+	g_free(history_file);
+	g_free(history_records_file);
+	g_free(bookmarks_file);
+
+	free(command_line);
+	strfreev(command_tokens);
+	history_free(history);
+	history_free(history_full);
+	blocklist_free(blocklist);
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	setup();
+
+	printf("%-32s %10s %14s %12s\n", "benchmark", "iterations", "ns/op", "allocs/op");
+
+	for (i = 0; i < (int)(sizeof benchmarks / sizeof benchmarks[0]); i++) {
+		if (argc > 1 && !strstr(benchmarks[i].name, argv[1])) {
+			/* filter by name */
+			continue;
+		}
+		run(&benchmarks[i]);
+	}
+
+	teardown();
+
+	return 0;
+}
@@ -0,0 +1,91 @@
+#!/bin/sh
+#
+# page-load benchmark
+#
+# Starts the local fixture server, drives ripcurl through
+# bench/pageload.replay with a fresh profile and compares load and
+# interaction timings (ms) with a saved baseline. Works offline.
+#
+# Usage: bench/pageload.sh [RIPCURL]
+#
+# BENCH_BASELINE  baseline file (default: bench/pageload.baseline)
+# BENCH_UPDATE=1  overwrite the baseline with this run
+# BENCH_PORT      HTTP port; HTTPS uses the next one (default: 8471)
+
+set -e
+
+RIPCURL=${1:-./ripcurl}
+DIR=$(cd "$(dirname "$0")" && pwd)
+BASELINE=${BENCH_BASELINE:-$DIR/pageload.baseline}
+HTTP_PORT=${BENCH_PORT:-8471}
+HTTPS_PORT=$((HTTP_PORT + 1))
+HTTP=http://127.0.0.1:$HTTP_PORT
+HTTPS=https://127.0.0.1:$HTTPS_PORT
+TMP=$(mktemp -d)
+SERVER=
+
+cleanup() {
+	[ -z "$SERVER" ] || kill "$SERVER" 2>/dev/null || true
+	rm -rf "$TMP"
+}
+trap cleanup EXIT INT TERM
+
+# self-signed certificate, ripcurl does not enforce strict ssl by default
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj /CN=127.0.0.1 \
+	-keyout "$TMP/key.pem" -out "$TMP/cert.pem" >/dev/null 2>&1
+
+python3 "$DIR/server.py" "$HTTP_PORT" "$HTTPS_PORT" "$TMP/cert.pem" "$TMP/key.pem" &
+SERVER=$!
+
+i=0
+until python3 -c "import socket; socket.create_connection(('127.0.0.1', $HTTP_PORT))" 2>/dev/null; do
+	i=$((i + 1))
+	if [ $i -gt 100 ]; then
+		echo "fixture server did not start" >&2
+		exit 1
+	fi
+	sleep 0.1
+done
+
+sed -e "s|@HTTP@|$HTTP|g" -e "s|@HTTPS@|$HTTPS|g" "$DIR/pageload.replay" > "$TMP/script"
+
+# fresh profile, no cookies, history or cache from earlier runs
+XDG_CONFIG_HOME=$TMP/config
+export XDG_CONFIG_HOME
+
+RUN=
+if [ -z "$DISPLAY" ]; then
+	RUN="xvfb-run -a"
+fi
+
+$RUN "$RIPCURL" --replay "$TMP/script" --replay-speed 0 --record "$TMP/record" \
+	"$HTTP/" > "$TMP/stdout"
+
+# "<name> <ms>" for every page load, command latency and the whole run
+{
+	sed -e "s|$HTTPS|https:|g" -e "s|$HTTP|http:|g" "$TMP/record" | awk '
+		$2 == "load" {
+			n[$4]++
+			printf "load:%s%s %s\n", $4, (n[$4] > 1 ? "#" n[$4] : ""), $3
+		}'
+	awk '
+		/^latency/ { table = 1; next }
+		table && NF == 7 { printf "latency:%s %s\n", $1, $3 }
+		/^replay finished/ { printf "total %s\n", $6 }' "$TMP/stdout"
+} > "$TMP/results"
+
+if [ ! -f "$BASELINE" ] || [ "$BENCH_UPDATE" = 1 ]; then
+	cp "$TMP/results" "$BASELINE"
+	echo "baseline written to $BASELINE"
+fi
+
+awk '
+	NR == FNR { base[$1] = $2; next }
+	FNR == 1 { printf "%-36s %10s %10s %8s\n", "pageload (ms)", "current", "baseline", "delta" }
+	{
+		if ($1 in base && base[$1] > 0) {
+			printf "%-36s %10.1f %10.1f %+7.1f%%\n", $1, $2, base[$1], ($2 - base[$1]) * 100 / base[$1]
+		} else {
+			printf "%-36s %10.1f %10s %8s\n", $1, $2, "-", "-"
+		}
+	}' "$BASELINE" "$TMP/results"
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""Local fixture server for the page-load benchmark.
+
+Serves a generated corpus over HTTP, and over HTTPS as well when given a
+certificate, so that the benchmark runs without network access:
+
+  /index.html       links to every page
+  /heavy.html       deep and wide DOM
+  /many.html        page with many small subresources
+  /text.html        large plain-text document
+  /slow.html        page whose response is delayed (?ms=N, default 500)
+  /res/N.{css,js,png}  subresources
+
+Usage: server.py PORT [HTTPS_PORT CERT KEY]
+"""
+
+import http.server
+import socketserver
+import ssl
+import sys
+import threading
+import time
+import urllib.parse
+
+SUBRESOURCES = 200
+HEAVY_ROWS = 2000
+TEXT_PARAGRAPHS = 20000
+
+LOREM = ("lorem ipsum dolor sit amet consectetur adipiscing elit sed do "
+         "eiusmod tempor incididunt ut labore et dolore magna aliqua")
+
+# 1x1 transparent png
+PNG = bytes.fromhex(
+    "89504e470d0a1a0a0000000d4948445200000001000000010806000000"
+    "1f15c4890000000d49444154789c6360000002000100e221bc330000000049454e44ae426082")
+
+
+def page(title, body, head=""):
+    return ("<!DOCTYPE html><html><head><meta charset=\"utf-8\">"
+            "<title>%s</title>%s</head><body>%s</body></html>"
+            % (title, head, body)).encode()
+
+
+def build_corpus():
+    corpus = {}
+
+    links = "".join("<li><a href=\"/%s\">%s</a></li>" % (p, p)
+                    for p in ("heavy.html", "many.html", "text.html", "slow.html"))
+    corpus["/index.html"] = ("text/html", page("index", "<ul>%s</ul>" % links))
+
+    rows = "".join("<tr>%s</tr>" % "".join("<td><span>%d.%d</span></td>" % (r, c)
+                                           for c in range(10))
+                   for r in range(HEAVY_ROWS))
+    corpus["/heavy.html"] = ("text/html",
+                             page("heavy", "<p>%s</p><table>%s</table>" % (LOREM, rows)))
+
+    head = "".join("<link rel=\"stylesheet\" href=\"/res/%d.css\">"
+                   "<script src=\"/res/%d.js\"></script>" % (i, i)
+                   for i in range(SUBRESOURCES))
+    imgs = "".join("<img src=\"/res/%d.png\">" % i for i in range(SUBRESOURCES))
+    corpus["/many.html"] = ("text/html", page("many", imgs, head))
+
+    text = "".join("<p>%d %s</p>" % (i, LOREM) for i in range(TEXT_PARAGRAPHS))
+    corpus["/text.html"] = ("text/html", page("text", text))
+
+    corpus["/slow.html"] = ("text/html", page("slow", "<p>%s</p>" % LOREM))
+
+    for i in range(SUBRESOURCES):
+        corpus["/res/%d.css" % i] = ("text/css", (".c%d { color: #%06x; }" % (i, i)).encode())
+        corpus["/res/%d.js" % i] = ("application/javascript", ("var v%d = %d;" % (i, i)).encode())
+        corpus["/res/%d.png" % i] = ("image/png", PNG)
+
+    return corpus
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    corpus = {}
+
+    def do_GET(self):
+        url = urllib.parse.urlsplit(self.path)
+        path = "/index.html" if url.path == "/" else url.path
+
+        if path not in self.corpus:
+            self.send_error(404)
+            return
+
+        if path == "/slow.html":
+            query = urllib.parse.parse_qs(url.query)
+            time.sleep(int(query.get("ms", ["500"])[0]) / 1000.0)
+
+        ctype, body = self.corpus[path]
+        self.send_response(200)
+        self.send_header("Content-Type", ctype)
+        self.send_header("Content-Length", str(len(body)))
+        self.send_header("Cache-Control", "no-store")
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, fmt, *args):
+        pass
+
+
+class Server(socketserver.ThreadingMixIn, http.server.HTTPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+def main():
+    if len(sys.argv) not in (2, 5):
+        sys.exit(__doc__)
+
+    Handler.corpus = build_corpus()
+
+    servers = [Server(("127.0.0.1", int(sys.argv[1])), Handler)]
+
+    if len(sys.argv) == 5:
+        https = Server(("127.0.0.1", int(sys.argv[2])), Handler)
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(sys.argv[3], sys.argv[4])
+        https.socket = context.wrap_socket(https.socket, server_side=True)
+        servers.append(https)
+
+    for server in servers[1:]:
+        threading.Thread(target=server.serve_forever, daemon=True).start()
+    servers[0].serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,537 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "utils.h"
+#include "blocklist.h"
+
+#define MAXURL		2048
+#define MAXHOST		256
+#define MAXTOKEN	64
+#define BLOOM_BITS	(1 << 18)
+
+typedef struct _Filter Filter;
+typedef struct _FilterIndex FilterIndex;
+
+/* a URL pattern: "*" matches anything, "^" a separator or the end */
+struct _Filter {
+	char *pattern;
+	gboolean anchor_start;	/* "|pattern": at the start of the URL */
+	gboolean anchor_domain;	/* "||pattern": at the start of a host label */
+	gboolean anchor_end;	/* "pattern|": at the end of the URL */
+};
+
+/*
+ * filters indexed by one token each - a URL can only match a filter if it
+ * contains the filter's token, so only those filters are tried. The bloom
+ * filter rejects most URL tokens before the hash table lookup.
+ */
+struct _FilterIndex {
+	GHashTable *tokens;		/* token -> GPtrArray of filters */
+	GPtrArray *untokenized;	/* filters without a usable token */
+	guint32 bloom[BLOOM_BITS / 32];
+};
+
+struct _Blocklist {
+	GHashTable *hosts;
+	GHashTable *exception_hosts;
+	FilterIndex block;
+	FilterIndex allow;
+	GPtrArray *filters;
+	unsigned int size;
+};
+
+/* options that restrict a rule in ways not supported here */
+static const char *unsupported_options[] = {
+	"domain", "popup", "document", "elemhide", "generichide", "genericblock",
+	"csp", "redirect", "removeparam", "rewrite", "replace", "badfilter",
+};
+
+static void filter_free(Filter *f)
+{
+	free(f->pattern);
+	free(f);
+}
+
+static void filter_index_init(FilterIndex *idx)
+{
+	idx->tokens = g_hash_table_new_full(g_str_hash, g_str_equal, free,
+			(GDestroyNotify)g_ptr_array_unref);
+	idx->untokenized = g_ptr_array_new();
+	memset(idx->bloom, 0, sizeof idx->bloom);
+}
+
+static void filter_index_clear(FilterIndex *idx)
+{
+	g_hash_table_destroy(idx->tokens);
+	g_ptr_array_unref(idx->untokenized);
+}
+
+static void bloom_bits(const char *token, guint32 *b1, guint32 *b2)
+{
+	guint32 fnv = 2166136261u, djb = 5381;
+
+	for (; *token; token++) {
+		fnv = (fnv ^ (guchar)*token) * 16777619u;
+		djb = djb * 33 + (guchar)*token;
+	}
+
+	*b1 = fnv % BLOOM_BITS;
+	*b2 = djb % BLOOM_BITS;
+}
+
+static void bloom_add(FilterIndex *idx, const char *token)
+{
+	guint32 b1, b2;
+
+	bloom_bits(token, &b1, &b2);
+	idx->bloom[b1 / 32] |= 1u << (b1 % 32);
+	idx->bloom[b2 / 32] |= 1u << (b2 % 32);
+}
+
+static gboolean bloom_check(FilterIndex *idx, const char *token)
+{
+	guint32 b1, b2;
+
+	bloom_bits(token, &b1, &b2);
+
+	return (idx->bloom[b1 / 32] & (1u << (b1 % 32)))
+		&& (idx->bloom[b2 / 32] & (1u << (b2 % 32)));
+}
+
+/*
+ * pick the longest alphanumeric run of the pattern that is a whole token in
+ * every URL the pattern matches, i.e. not next to a wildcard or an
+ * unanchored end of the pattern
+ *
+ * Return: dynamically allocated token, NULL if there is none
+ */
+static char *filter_token(Filter *f)
+{
+	const char *p, *start, *best = NULL;
+	size_t len, best_len = 0;
+
+	for (p = f->pattern; *p; ) {
+		if (!g_ascii_isalnum(*p)) {
+			p++;
+			continue;
+		}
+
+		for (start = p; g_ascii_isalnum(*p); p++);
+		len = p - start;
+
+		if (start == f->pattern ? !(f->anchor_start || f->anchor_domain) : start[-1] == '*') {
+			/* may continue to the left */
+			continue;
+		}
+		if (*p == '\0' ? !f->anchor_end : *p == '*') {
+			/* may continue to the right */
+			continue;
+		}
+
+		if (len > best_len && len < MAXTOKEN) {
+			best = start;
+			best_len = len;
+		}
+	}
+
+	return best ? g_strndup(best, best_len) : NULL;
+}
+
+static void filter_index_add(FilterIndex *idx, Filter *f)
+{
+	GPtrArray *bucket;
+	char *token;
+
+	if (!(token = filter_token(f))) {
+		g_ptr_array_add(idx->untokenized, f);
+		return;
+	}
+
+	if ((bucket = g_hash_table_lookup(idx->tokens, token))) {
+		g_free(token);
+	} else {
+		bucket = g_ptr_array_new();
+		bloom_add(idx, token);
+		g_hash_table_insert(idx->tokens, strdup(token), bucket);
+		g_free(token);
+	}
+
+	g_ptr_array_add(bucket, f);
+}
+
+static gboolean is_separator(char c)
+{
+	return !(g_ascii_isalnum(c) || c == '_' || c == '-' || c == '.' || c == '%');
+}
+
+/*
+ * match pattern against str, anywhere in str if floating is set
+ */
+static gboolean glob_match(const char *p, const char *s, gboolean floating, gboolean anchor_end)
+{
+	const char *star_p = NULL, *star_s = NULL;
+
+	if (floating) {
+		star_p = p;
+		star_s = s;
+	}
+
+	for (;;) {
+		if (*p == '*') {
+			star_p = ++p;
+			star_s = s;
+			continue;
+		}
+
+		if (!*p) {
+			if (!anchor_end || !*s) {
+				return TRUE;
+			}
+		} else if (*p == '^' && !*s) {
+			/* separator matches the end, too */
+			p++;
+			continue;
+		} else if (*s && (*p == *s || (*p == '^' && is_separator(*s)))) {
+			p++;
+			s++;
+			continue;
+		}
+
+		/* mismatch - retry one character further after the last wildcard */
+		if (star_p && *star_s) {
+			p = star_p;
+			s = ++star_s;
+			continue;
+		}
+
+		return FALSE;
+	}
+}
+
+static gboolean filter_match(Filter *f, const char *url, const char *host, size_t host_len)
+{
+	const char *p;
+
+	if (f->anchor_domain) {
+		for (p = host; p < host + host_len; p++) {
+			if ((p == host || p[-1] == '.') && glob_match(f->pattern, p, FALSE, f->anchor_end)) {
+				return TRUE;
+			}
+		}
+		return FALSE;
+	}
+
+	return glob_match(f->pattern, url, !f->anchor_start, f->anchor_end);
+}
+
+static gboolean filter_index_match(FilterIndex *idx, const char *url, const char *host, size_t host_len)
+{
+	GPtrArray *bucket;
+	const char *p, *start;
+	char token[MAXTOKEN];
+	size_t len;
+	unsigned int i;
+
+	for (p = url; *p; ) {
+		if (!g_ascii_isalnum(*p)) {
+			p++;
+			continue;
+		}
+
+		for (start = p; g_ascii_isalnum(*p); p++);
+		len = p - start;
+		if (len >= MAXTOKEN) {
+			continue;
+		}
+
+		memcpy(token, start, len);
+		token[len] = '\0';
+
+		if (!bloom_check(idx, token) || !(bucket = g_hash_table_lookup(idx->tokens, token))) {
+			continue;
+		}
+
+		for (i = 0; i < bucket->len; i++) {
+			if (filter_match(g_ptr_array_index(bucket, i), url, host, host_len)) {
+				return TRUE;
+			}
+		}
+	}
+
+	for (i = 0; i < idx->untokenized->len; i++) {
+		if (filter_match(g_ptr_array_index(idx->untokenized, i), url, host, host_len)) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * check host and its parent domains against a host set
+ */
+static gboolean host_listed(GHashTable *hosts, const char *host)
+{
+	const char *p;
+
+	for (p = host; p && *p; p = (p = strchr(p, '.')) ? p + 1 : NULL) {
+		if (g_hash_table_contains(hosts, p)) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static gboolean is_hostname(const char *str, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (!(g_ascii_isalnum(str[i]) || str[i] == '.' || str[i] == '-')) {
+			return FALSE;
+		}
+	}
+
+	return len > 0;
+}
+
+static gboolean options_supported(char *options)
+{
+	char **tokens, *name;
+	unsigned int i, j;
+	gboolean supported = TRUE;
+
+	tokens = tokenize(options, ",");
+
+	for (i = 0; tokens[i] && supported; i++) {
+		name = (tokens[i][0] == '~') ? tokens[i] + 1 : tokens[i];
+		for (j = 0; j < G_N_ELEMENTS(unsupported_options); j++) {
+			if (!strncmp(name, unsupported_options[j], strlen(unsupported_options[j]))) {
+				supported = FALSE;
+				break;
+			}
+		}
+	}
+
+	strfreev(tokens);
+
+	return supported;
+}
+
+Blocklist *blocklist_new(void)
+{
+	Blocklist *bl;
+
+	bl = emalloc(sizeof *bl);
+	bl->hosts = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+	bl->exception_hosts = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+	filter_index_init(&bl->block);
+	filter_index_init(&bl->allow);
+	bl->filters = g_ptr_array_new_with_free_func((GDestroyNotify)filter_free);
+	bl->size = 0;
+
+	return bl;
+}
+
+/*
+ * add a rule in EasyList ("||ads.example.com^", "/ads/banner", "@@...") or
+ * hosts file ("0.0.0.0 ads.example.com") syntax
+ *
+ * Element hiding and regular expression rules are ignored, as are rules
+ * with options that restrict them to some sites. Other options (resource
+ * types, third-party) are dropped, so those rules apply to every request.
+ */
+void blocklist_add_rule(Blocklist *bl, char *rule)
+{
+	char *line, *p, *q, **hosts;
+	gboolean exception = FALSE;
+	Filter *f;
+	size_t len;
+	int i;
+
+	line = g_ascii_strdown(rule, -1);
+	p = g_strstrip(line);
+
+	if (!*p || *p == '!' || *p == '[' || *p == '#'
+			|| strstr(p, "##") || strstr(p, "#@#") || strstr(p, "#?#")) {
+		/* comment or element hiding */
+		goto out;
+	}
+
+	/* hosts file */
+	if (g_ascii_isdigit(*p) && (q = strpbrk(p, " \t"))) {
+		if ((p = strchr(q, '#'))) {
+			*p = '\0';
+		}
+		/* one or more hosts per line */
+		hosts = tokenize(q, " \t");
+		for (i = 0; hosts[i]; i++) {
+			p = hosts[i];
+			if (is_hostname(p, strlen(p)) && strcmp(p, "localhost")
+					&& !g_hash_table_contains(bl->hosts, p)) {
+				g_hash_table_add(bl->hosts, strdup(p));
+				bl->size++;
+			}
+		}
+		strfreev(hosts);
+		goto out;
+	}
+
+	if (!strncmp(p, "@@", 2)) {
+		exception = TRUE;
+		p += 2;
+	}
+
+	if ((q = strrchr(p, '$'))) {
+		*q = '\0';
+		if (!options_supported(q + 1)) {
+			goto out;
+		}
+	}
+
+	len = strlen(p);
+	if (len > 1 && p[0] == '/' && p[len - 1] == '/') {
+		/* regular expression */
+		goto out;
+	}
+
+	f = emalloc(sizeof *f);
+	f->anchor_start = f->anchor_domain = f->anchor_end = FALSE;
+
+	if (!strncmp(p, "||", 2)) {
+		f->anchor_domain = TRUE;
+		p += 2;
+	} else if (*p == '|') {
+		f->anchor_start = TRUE;
+		p++;
+	}
+
+	len = strlen(p);
+	if (len > 0 && p[len - 1] == '|') {
+		f->anchor_end = TRUE;
+		p[--len] = '\0';
+	}
+
+	/* leading and trailing wildcards only undo anchors */
+	if (*p == '*' && !f->anchor_domain) {
+		f->anchor_start = FALSE;
+		for (; *p == '*'; p++, len--);
+	}
+	if (len > 0 && p[len - 1] == '*') {
+		f->anchor_end = FALSE;
+		for (; len > 0 && p[len - 1] == '*'; len--);
+		p[len] = '\0';
+	}
+
+	if (!*p) {
+		/* would match everything */
+		free(f);
+		goto out;
+	}
+
+	/* "||host^" - a plain host rule */
+	if (f->anchor_domain && !f->anchor_end && len > 1 && p[len - 1] == '^'
+			&& is_hostname(p, len - 1)) {
+		p[len - 1] = '\0';
+		free(f);
+		if (!g_hash_table_contains(exception ? bl->exception_hosts : bl->hosts, p)) {
+			g_hash_table_add(exception ? bl->exception_hosts : bl->hosts, strdup(p));
+			bl->size++;
+		}
+		goto out;
+	}
+
+	f->pattern = strdup(p);
+	g_ptr_array_add(bl->filters, f);
+	filter_index_add(exception ? &bl->allow : &bl->block, f);
+	bl->size++;
+
+out:
+	g_free(line);
+}
+
+/*
+ * add the rules of a blocklist file
+ *
+ * Return: number of rules added
+ */
+int blocklist_load(Blocklist *bl, char *filename)
+{
+	GList *lines, *list;
+	unsigned int size = bl->size;
+
+	lines = read_file(filename, NULL);
+
+	for (list = lines; list; list = g_list_next(list)) {
+		blocklist_add_rule(bl, list->data);
+		free(list->data);
+	}
+	g_list_free(lines);
+
+	return bl->size - size;
+}
+
+/*
+ * check if uri is blocked and not excepted
+ */
+gboolean blocklist_match(Blocklist *bl, const char *uri)
+{
+	char buf[MAXURL], hostbuf[MAXHOST], *url;
+	const char *host;
+	size_t len, host_len, i;
+	gboolean blocked = FALSE;
+
+	/* rules are case-insensitive */
+	len = strlen(uri);
+	url = (len < sizeof buf) ? buf : emalloc(len + 1);
+	for (i = 0; i <= len; i++) {
+		url[i] = g_ascii_tolower(uri[i]);
+	}
+
+	if ((host = strstr(url, "://"))) {
+		host += 3;
+		host_len = strcspn(host, "/?#:");
+	} else {
+		host = url;
+		host_len = 0;
+	}
+	if (host_len >= sizeof hostbuf) {
+		host_len = 0;
+	}
+	memcpy(hostbuf, host, host_len);
+	hostbuf[host_len] = '\0';
+
+	if (host_listed(bl->hosts, hostbuf) || filter_index_match(&bl->block, url, host, host_len)) {
+		blocked = !(host_listed(bl->exception_hosts, hostbuf)
+				|| filter_index_match(&bl->allow, url, host, host_len));
+	}
+
+	if (url != buf) {
+		free(url);
+	}
+
+	return blocked;
+}
+
+unsigned int blocklist_size(Blocklist *bl)
+{
+	return bl->size;
+}
+
+void blocklist_free(Blocklist *bl)
+{
+	if (!bl) {
+		return;
+	}
+
+	g_hash_table_destroy(bl->hosts);
+	g_hash_table_destroy(bl->exception_hosts);
+	filter_index_clear(&bl->block);
+	filter_index_clear(&bl->allow);
+	g_ptr_array_unref(bl->filters);
+	free(bl);
+}
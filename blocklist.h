@@ -0,0 +1,13 @@
+#ifndef __BLOCKLIST_H__
+#define __BLOCKLIST_H__
+
+typedef struct _Blocklist Blocklist;
+
+Blocklist *blocklist_new(void);
+int blocklist_load(Blocklist *bl, char *filename);
+void blocklist_add_rule(Blocklist *bl, char *rule);
+gboolean blocklist_match(Blocklist *bl, const char *uri);
+unsigned int blocklist_size(Blocklist *bl);
+void blocklist_free(Blocklist *bl);
+
+#endif /* __BLOCKLIST_H__ */
@@ -2,16 +2,52 @@
 static char *config_dir		=	"~/.config/ripcurl";
 static char *bookmarks_file	=	"bookmarks";
 static char *history_file	=	"history";
-static char *cookie_file	=	"cookies";
+static char *cookie_file	=	"cookies.sqlite";
+static char *cookie_text_file	=	"cookies";	/* migrated to cookie_file */
+static char *cache_dir		=	"cache";
+static char *session_file	=	"session";
+static char *index_file		=	"index";
 static char *ca_file 		=	"/etc/ssl/certs/ca-certificates.crt";
 
+/* EasyList or hosts file syntax, relative to config_dir */
+static char *blocklist_files[] = { "blocklist", NULL };
+
 /* browser settings */
 char *user_agent			=	NULL;
 char *home_page				=	"https://duckduckgo.com";
-int history_limit			=	0;
+int history_limit			=	0;		/* max history entries, 0 for no limit */
+int history_max_age			=	0;		/* days a history entry is kept, 0 forever */
+gboolean history_index		=	FALSE;	/* index the text of visited pages for :hsearch */
 gboolean strict_ssl			=	FALSE;
 gboolean private_browsing	=	FALSE;
 gboolean developer_extras	=	TRUE;
+int cache_size				=	50;		/* http disk cache in MiB, 0 disables */
+gboolean offline_detect		=	TRUE;	/* serve from cache when the network is down */
+
+/* link hover settings, servers see (and may log) these requests even for links never followed */
+gboolean hover_preconnect	=	FALSE;	/* resolve and connect to hovered links' hosts with a cookieless HEAD / */
+int hover_delay				=	150;	/* ms the pointer must rest on a link */
+int preconnect_rate			=	4;		/* max preconnects per second */
+int preconnect_ttl			=	30;		/* seconds a connection is considered warm */
+gboolean hover_prefetch		=	FALSE;	/* fetch hovered links' documents into the cache */
+int prefetch_budget			=	2097152;	/* max prefetched bytes per minute */
+
+/* window suspension */
+int suspend_ttl				=	600;	/* seconds unfocused until a window's page is unloaded, 0 disables */
+int live_windows			=	8;		/* max windows with a loaded page, 0 for no limit */
+gboolean spare_window		=	TRUE;	/* keep a hidden window built for the next one opened */
+int autosave_interval		=	60;		/* seconds between saves of the session and changed history and bookmarks, 0 saves on exit only */
+
+/* memory pressure, resident size in MiB, 0 disables */
+int memory_soft_limit		=	768;	/* shrink caches */
+int memory_hard_limit		=	1280;	/* also suspend windows */
+
+/* per-site settings, "*.example.com" also matches the subdomains */
+SiteRule site_rules[] = {
+	/* host						scripts		images		plugins */
+	{ "*.news.example",			OFF,		DEFAULT,	DEFAULT },
+	{ "*.heavy.example",		DEFAULT,	OFF,		OFF },
+};
 
 /* download settings */
 char *download_dir	=	"~/Downloads";
@@ -70,12 +106,17 @@ InputbarShortcut inputbar_shortcuts[] = {
 Command commands[] = {
 	{ "back",		0,		cmd_back },
 	{ "bmark",		"b",	cmd_bookmark },
+	{ "cache",		0,		cmd_cache },
 	{ "forward",	0,		cmd_forward },
+	{ "hsearch",	0,		cmd_hsearch },
+	{ "lite",		0,		cmd_lite },
+	{ "offline",	0,		cmd_offline },
 	{ "open",		"o",	cmd_open },
 	{ "print",		0,		cmd_print },
 	{ "quit",		"q",	cmd_quit },
 	{ "quitall",	"Q",	cmd_quitall },
 	{ "reload",		"r",	cmd_reload },
+	{ "stats",		0,		cmd_stats },
 	{ "winopen",	"W",	cmd_winopen },
 };
 
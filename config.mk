@@ -14,6 +14,12 @@ LIBS = -lc ${GTK_LIB} -lm
 # flags
 CFLAGS += -Wall ${INCS}
 
+# benchmarks (glib only, no GTK)
+BENCH_INC = $(shell pkg-config --cflags glib-2.0)
+BENCH_LIB = $(shell pkg-config --libs glib-2.0)
+BENCH_FLAGS = -O2 -Wall -I. ${BENCH_INC}
+BENCH_WRAP = -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=strdup
+
 # debug
 DFLAGS = -O0 -g
 
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "utils.h"
+#include "history.h"
+
+#define MAXLINE 1024
+
+/*
+ * history file format, all integers little-endian:
+ *
+ *   "RCHI" u32 version
+ *   records, least recently visited first:
+ *     u32 length, uri
+ *     u32 length, title (length 0 for none)
+ *     i64 first visit, i64 last visit, u32 visits
+ */
+#define HISTORY_MAGIC	"RCHI"
+#define HISTORY_VERSION	1
+
+struct _History {
+	GQueue entries;			/* most recent at the head */
+	GHashTable *links;		/* uri -> link in entries */
+	int limit;				/* max entries, 0 for no limit */
+	gint64 max_age;			/* seconds, 0 to keep entries forever */
+	GFunc evicted;			/* called with each evicted entry, may be NULL */
+	gpointer evicted_data;
+};
+
+static void entry_free(HistoryEntry *e)
+{
+	free(e->uri);
+	free(e->title);
+	free(e);
+}
+
+static void history_evict(History *h)
+{
+	HistoryEntry *e = g_queue_pop_tail(&h->entries);
+
+	g_hash_table_remove(h->links, e->uri);
+	if (h->evicted) {
+		h->evicted(e, h->evicted_data);
+	}
+	entry_free(e);
+}
+
+History *history_new(int limit, gint64 max_age)
+{
+	History *h = emalloc(sizeof *h);
+
+	g_queue_init(&h->entries);
+	h->links = g_hash_table_new(g_str_hash, g_str_equal);
+	h->limit = limit;
+	h->max_age = max_age;
+	h->evicted = NULL;
+	h->evicted_data = NULL;
+
+	return h;
+}
+
+/*
+ * call func with each entry dropped over the limit or for its age, before
+ * it is freed
+ */
+void history_set_evict_func(History *h, GFunc func, gpointer data)
+{
+	h->evicted = func;
+	h->evicted_data = data;
+}
+
+/*
+ * find the entry of uri and move it to the front, adding it if it is new,
+ * and evict the least recently visited entry when over the limit
+ *
+ * Return: the entry, visits is 0 for new ones
+ */
+static HistoryEntry *history_touch(History *h, const char *uri)
+{
+	HistoryEntry *e;
+	GList *link;
+
+	if ((link = g_hash_table_lookup(h->links, uri))) {
+		g_queue_unlink(&h->entries, link);
+		g_queue_push_head_link(&h->entries, link);
+		return link->data;
+	}
+
+	e = emalloc(sizeof *e);
+	e->uri = strdup(uri);
+	e->title = NULL;
+	e->first_visit = e->last_visit = 0;
+	e->visits = 0;
+	g_queue_push_head(&h->entries, e);
+	/* keys are owned by the entries */
+	g_hash_table_insert(h->links, e->uri, h->entries.head);
+
+	while (h->limit > 0 && h->entries.length > (guint)h->limit) {
+		history_evict(h);
+	}
+
+	return e;
+}
+
+/*
+ * record a visit of uri at time, title may be NULL
+ */
+void history_visit(History *h, const char *uri, const char *title, gint64 time)
+{
+	HistoryEntry *e = history_touch(h, uri);
+
+	if (!e->visits++) {
+		e->first_visit = time;
+	}
+	e->last_visit = time;
+
+	if (title && *title && strcmp_s(title, e->title)) {
+		free(e->title);
+		e->title = strdup(title);
+	}
+
+	history_expire(h, time);
+}
+
+/*
+ * add the visits of older to the entries of h that it also has, append
+ * the others as far as the limit allows, and free older
+ */
+void history_merge(History *h, History *older)
+{
+	HistoryEntry *e, *newer;
+	GList *link;
+
+	while ((e = g_queue_pop_head(&older->entries))) {
+		if ((link = g_hash_table_lookup(h->links, e->uri))) {
+			newer = link->data;
+			newer->visits += e->visits;
+			newer->first_visit = MIN(newer->first_visit, e->first_visit);
+			newer->last_visit = MAX(newer->last_visit, e->last_visit);
+			if (!newer->title) {
+				newer->title = e->title;
+				e->title = NULL;
+			}
+			entry_free(e);
+			continue;
+		}
+		if (h->limit > 0 && h->entries.length >= (guint)h->limit) {
+			entry_free(e);
+			continue;
+		}
+		g_queue_push_tail(&h->entries, e);
+		g_hash_table_insert(h->links, e->uri, h->entries.tail);
+	}
+
+	g_hash_table_remove_all(older->links);
+	history_free(older);
+}
+
+/*
+ * drop the entries visited more than max_age seconds before now, they are
+ * all at the tail
+ */
+void history_expire(History *h, gint64 now)
+{
+	HistoryEntry *e;
+
+	if (h->max_age <= 0) {
+		return;
+	}
+
+	while ((e = g_queue_peek_tail(&h->entries)) && now - e->last_visit > h->max_age) {
+		history_evict(h);
+	}
+}
+
+/*
+ * add the entries of a flat history file, one "<uri> [<time>]" per line
+ * with the most recent last. Lines without a time are taken to be as old
+ * as the file.
+ *
+ * Return: the number of entries read
+ */
+static int history_read_flat(History *h, FILE *fp)
+{
+	struct stat st;
+	char *line, *time;
+	size_t nbytes = MAXLINE;
+	gint64 mtime, visited;
+	int n = 0;
+
+	mtime = fstat(fileno(fp), &st) ? g_get_real_time() / G_USEC_PER_SEC : st.st_mtime;
+
+	line = emalloc(nbytes * sizeof *line);
+
+	while (getline(&line, &nbytes, fp) != -1) {
+		chomp(line);
+		if (strlen(line) == 0) {
+			continue;
+		}
+
+		visited = mtime;
+		if ((time = strchr(line, ' '))) {
+			*time++ = '\0';
+			visited = g_ascii_strtoll(time, NULL, 10);
+		}
+
+		history_visit(h, line, NULL, visited);
+		n++;
+	}
+
+	free(line);
+
+	return n;
+}
+
+/*
+ * read a length-prefixed string at *p, advancing *p
+ *
+ * Return: dynamically allocated string, NULL if empty or truncated
+ */
+static char *read_string(const char **p, const char *end, gboolean *ok)
+{
+	guint32 len;
+	char *str;
+
+	if (end - *p < 4) {
+		*ok = FALSE;
+		return NULL;
+	}
+	memcpy(&len, *p, 4);
+	len = GUINT32_FROM_LE(len);
+	*p += 4;
+
+	if ((guint32)(end - *p) < len) {
+		*ok = FALSE;
+		return NULL;
+	}
+
+	str = len ? g_strndup(*p, len) : NULL;
+	*p += len;
+
+	return str;
+}
+
+static gint64 read_int64(const char **p)
+{
+	gint64 v;
+
+	memcpy(&v, *p, 8);
+	*p += 8;
+
+	return GINT64_FROM_LE(v);
+}
+
+/*
+ * add the entries of the records in data
+ *
+ * Return: the number of entries read
+ */
+static int history_read_records(History *h, const char *data, gsize length)
+{
+	const char *p = data + 8, *end = data + length;
+	HistoryEntry *e;
+	char *uri, *title;
+	guint32 visits;
+	gboolean ok = TRUE;
+	int n = 0;
+
+	while (p < end) {
+		uri = read_string(&p, end, &ok);
+		title = read_string(&p, end, &ok);
+		if (!ok || !uri || end - p < 20) {
+			print_err("history file truncated after %d entries\n", n);
+			free(uri);
+			free(title);
+			break;
+		}
+
+		/* records are in visit order, so this appends at the front */
+		e = history_touch(h, uri);
+		free(e->title);
+		e->title = title;
+		e->first_visit = read_int64(&p);
+		e->last_visit = read_int64(&p);
+		memcpy(&visits, p, 4);
+		e->visits = GUINT32_FROM_LE(visits);
+		p += 4;
+
+		free(uri);
+		n++;
+	}
+
+	return n;
+}
+
+/*
+ * add the entries of a history file, in the record format or the older
+ * flat one - legacy is set for the latter so the caller can rewrite it
+ *
+ * Return: the number of entries read
+ */
+int history_read_file(History *h, const char *filename, gboolean *legacy)
+{
+	FILE *fp;
+	char *data;
+	gsize length;
+	guint32 version;
+	int n;
+
+	*legacy = FALSE;
+
+	/* the whole file at once, records are parsed in place */
+	if (!g_file_get_contents(filename, &data, &length, NULL)) {
+		/* file not found */
+		return 0;
+	}
+
+	if (length >= 8 && !memcmp(data, HISTORY_MAGIC, 4)) {
+		memcpy(&version, data + 4, 4);
+		version = GUINT32_FROM_LE(version);
+		if (version > HISTORY_VERSION) {
+			print_err("history file \"%s\" has unknown version %u\n", filename, version);
+			n = 0;
+		} else {
+			n = history_read_records(h, data, length);
+		}
+		g_free(data);
+	} else {
+		g_free(data);
+
+		if (!(fp = fopen(filename, "r"))) {
+			return 0;
+		}
+		n = history_read_flat(h, fp);
+		*legacy = TRUE;
+
+		if (fclose(fp)) {
+			print_err("unable to close file \"%s\"\n", filename);
+		}
+	}
+
+	history_expire(h, g_get_real_time() / G_USEC_PER_SEC);
+
+	return n;
+}
+
+static void append_string(GString *data, const char *str)
+{
+	guint32 len = str ? strlen(str) : 0;
+	guint32 le = GUINT32_TO_LE(len);
+
+	g_string_append_len(data, (char *)&le, 4);
+	if (len) {
+		g_string_append_len(data, str, len);
+	}
+}
+
+static void append_record(gpointer entry, gpointer data)
+{
+	HistoryEntry *e = entry;
+	gint64 first = GINT64_TO_LE(e->first_visit), last = GINT64_TO_LE(e->last_visit);
+	guint32 visits = GUINT32_TO_LE(e->visits);
+
+	append_string(data, e->uri);
+	append_string(data, e->title);
+	g_string_append_len(data, (char *)&first, 8);
+	g_string_append_len(data, (char *)&last, 8);
+	g_string_append_len(data, (char *)&visits, 4);
+}
+
+/*
+ * Return: the history in the file format
+ */
+GString *history_serialize(History *h)
+{
+	GString *data = g_string_sized_new(64 * (h->entries.length + 1));
+	guint32 version = GUINT32_TO_LE(HISTORY_VERSION);
+
+	g_string_append_len(data, HISTORY_MAGIC, 4);
+	g_string_append_len(data, (char *)&version, 4);
+	history_foreach(h, append_record, data);
+
+	return data;
+}
+
+/*
+ * call func for each entry, least recently visited first
+ */
+void history_foreach(History *h, GFunc func, gpointer data)
+{
+	GList *link;
+
+	for (link = h->entries.tail; link; link = g_list_previous(link)) {
+		func(link->data, data);
+	}
+}
+
+void history_free(History *h)
+{
+	if (!h) {
+		return;
+	}
+
+	g_queue_foreach(&h->entries, (GFunc)entry_free, NULL);
+	g_queue_clear(&h->entries);
+	g_hash_table_destroy(h->links);
+	free(h);
+}
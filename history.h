@@ -0,0 +1,29 @@
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+/*
+ * visited uris, most recent first, bounded by a number of entries and an
+ * age - adding a visit and evicting the oldest entry are O(1)
+ */
+typedef struct _History History;
+typedef struct _HistoryEntry HistoryEntry;
+
+struct _HistoryEntry {
+	char *uri;
+	char *title;		/* NULL if unknown */
+	gint64 first_visit;	/* unix time in seconds */
+	gint64 last_visit;
+	guint32 visits;
+};
+
+History *history_new(int limit, gint64 max_age);
+void history_set_evict_func(History *h, GFunc func, gpointer data);
+void history_visit(History *h, const char *uri, const char *title, gint64 time);
+void history_merge(History *h, History *older);
+void history_expire(History *h, gint64 now);
+int history_read_file(History *h, const char *filename, gboolean *legacy);
+GString *history_serialize(History *h);
+void history_foreach(History *h, GFunc func, gpointer data);
+void history_free(History *h);
+
+#endif /* __HISTORY_H__ */
@@ -0,0 +1,786 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "utils.h"
+#include "index.h"
+
+/*
+ * index log format, all integers little-endian:
+ *
+ *   "RCIX" u32 version
+ *   one record per indexed page, a later record of an uri replaces an
+ *   earlier one and a record without terms removes the uri:
+ *     u32 length, uri
+ *     u32 length, title
+ *     u32 terms, then per term: u32 length, term, u32 frequency
+ */
+#define INDEX_MAGIC		"RCIX"
+#define INDEX_VERSION	1
+#define MIN_TERM		2		/* characters */
+#define MAX_TERM		32
+#define MIN_COMPACT		64		/* stale records before the index is compacted */
+
+typedef struct _Document Document;
+typedef struct _Posting Posting;
+typedef struct _IndexJob IndexJob;
+
+struct _Document {
+	char *uri;
+	char *title;
+	guint32 length;			/* terms in the document */
+	gboolean live;			/* FALSE once the uri was indexed again or removed */
+};
+
+struct _Posting {
+	guint32 doc;
+	guint32 frequency;
+};
+
+enum { JOB_ADD, JOB_REMOVE, JOB_RETAIN, JOB_TRIM, JOB_STOP };
+
+struct _IndexJob {
+	int type;
+	char *uri;
+	char *title;
+	char *text;
+	GHashTable *uris;		/* JOB_RETAIN: the uris to keep */
+};
+
+struct _Index {
+	char *filename;
+	GThread *thread;
+	GAsyncQueue *queue;
+	GMutex lock;			/* guards everything below */
+	GPtrArray *documents;	/* doc id -> Document */
+	GHashTable *uris;		/* uri -> doc id + 1 of its live document */
+	GHashTable *terms;		/* term -> GArray of Posting */
+	unsigned int live;
+	unsigned int records;	/* in the log, worker thread only */
+	gboolean fresh;			/* start the log over on the next append */
+};
+
+static void document_free(Document *d)
+{
+	free(d->uri);
+	free(d->title);
+	free(d);
+}
+
+static void postings_free(GArray *postings)
+{
+	g_array_free(postings, TRUE);
+}
+
+static IndexJob *job_new(int type)
+{
+	IndexJob *job = emalloc(sizeof *job);
+
+	job->type = type;
+	job->uri = job->title = job->text = NULL;
+	job->uris = NULL;
+
+	return job;
+}
+
+static void job_free(IndexJob *job)
+{
+	free(job->uri);
+	free(job->title);
+	free(job->text);
+	if (job->uris) {
+		g_hash_table_destroy(job->uris);
+	}
+	free(job);
+}
+
+/*
+ * split text into lowercase terms of letters and digits
+ *
+ * Return: term -> frequency, the total number of terms in *length
+ */
+static GHashTable *tokenize_text(const char *text, guint32 *length)
+{
+	GHashTable *counts;
+	GString *term;
+	const char *p;
+	gunichar c;
+	gpointer n;
+
+	counts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	term = g_string_new(NULL);
+	*length = 0;
+
+	for (p = text; ; p = g_utf8_next_char(p)) {
+		c = *p ? g_utf8_get_char_validated(p, -1) : 0;
+		if (c == (gunichar)-1 || c == (gunichar)-2) {
+			/* invalid utf-8 - stop here */
+			c = 0;
+		}
+
+		if (c && g_unichar_isalnum(c)) {
+			g_string_append_unichar(term, g_unichar_tolower(c));
+			continue;
+		}
+
+		if (g_utf8_strlen(term->str, term->len) >= MIN_TERM
+				&& g_utf8_strlen(term->str, term->len) <= MAX_TERM) {
+			n = g_hash_table_lookup(counts, term->str);
+			g_hash_table_replace(counts, g_strdup(term->str), GUINT_TO_POINTER(GPOINTER_TO_UINT(n) + 1));
+			(*length)++;
+		}
+		g_string_truncate(term, 0);
+
+		if (!c) {
+			break;
+		}
+	}
+
+	g_string_free(term, TRUE);
+
+	return counts;
+}
+
+/*
+ * mark the document of uri as dead, its postings stay until the index is
+ * compacted - called with the lock held
+ */
+static void index_delete(Index *idx, const char *uri)
+{
+	gpointer old;
+
+	if ((old = g_hash_table_lookup(idx->uris, uri))) {
+		g_hash_table_remove(idx->uris, uri);
+		((Document *)g_ptr_array_index(idx->documents, GPOINTER_TO_UINT(old) - 1))->live = FALSE;
+		idx->live--;
+	}
+}
+
+/*
+ * add a document with its term frequencies, replacing an earlier one of
+ * the same uri, or only remove that one if there are no terms - called
+ * with the lock held, uri and title are taken over
+ */
+static void index_insert(Index *idx, char *uri, char *title, GHashTable *counts, guint32 length)
+{
+	GHashTableIter iter;
+	gpointer term, frequency;
+	Document *d;
+	GArray *postings;
+	Posting posting;
+
+	index_delete(idx, uri);
+
+	if (!g_hash_table_size(counts)) {
+		free(uri);
+		free(title);
+		return;
+	}
+
+	d = emalloc(sizeof *d);
+	d->uri = uri;
+	d->title = title;
+	d->length = length;
+	d->live = TRUE;
+	g_ptr_array_add(idx->documents, d);
+	idx->live++;
+
+	posting.doc = idx->documents->len - 1;
+	g_hash_table_replace(idx->uris, d->uri, GUINT_TO_POINTER(posting.doc + 1));
+
+	g_hash_table_iter_init(&iter, counts);
+	while (g_hash_table_iter_next(&iter, &term, &frequency)) {
+		if (!(postings = g_hash_table_lookup(idx->terms, term))) {
+			postings = g_array_new(FALSE, FALSE, sizeof(Posting));
+			g_hash_table_insert(idx->terms, strdup(term), postings);
+		}
+		posting.frequency = GPOINTER_TO_UINT(frequency);
+		g_array_append_val(postings, posting);
+	}
+}
+
+static void append_string(GString *data, const char *str)
+{
+	guint32 len = str ? strlen(str) : 0;
+	guint32 le = GUINT32_TO_LE(len);
+
+	g_string_append_len(data, (char *)&le, 4);
+	if (len) {
+		g_string_append_len(data, str, len);
+	}
+}
+
+static void append_uint32(GString *data, guint32 value)
+{
+	value = GUINT32_TO_LE(value);
+	g_string_append_len(data, (char *)&value, 4);
+}
+
+static void append_record(GString *data, const char *uri, const char *title, GHashTable *counts)
+{
+	GHashTableIter iter;
+	gpointer term, frequency;
+
+	append_string(data, uri);
+	append_string(data, title);
+	append_uint32(data, g_hash_table_size(counts));
+
+	g_hash_table_iter_init(&iter, counts);
+	while (g_hash_table_iter_next(&iter, &term, &frequency)) {
+		append_string(data, term);
+		append_uint32(data, GPOINTER_TO_UINT(frequency));
+	}
+}
+
+/*
+ * read a length-prefixed string at *p, advancing *p
+ *
+ * Return: dynamically allocated string, NULL if truncated
+ */
+static char *read_string(const char **p, const char *end)
+{
+	guint32 len;
+	char *str;
+
+	if (end - *p < 4) {
+		return NULL;
+	}
+	memcpy(&len, *p, 4);
+	len = GUINT32_FROM_LE(len);
+
+	if ((guint32)(end - *p - 4) < len) {
+		return NULL;
+	}
+
+	str = g_strndup(*p + 4, len);
+	*p += 4 + len;
+
+	return str;
+}
+
+static gboolean read_uint32(const char **p, const char *end, guint32 *value)
+{
+	if (end - *p < 4) {
+		return FALSE;
+	}
+	memcpy(value, *p, 4);
+	*value = GUINT32_FROM_LE(*value);
+	*p += 4;
+
+	return TRUE;
+}
+
+/*
+ * replay the log into the index
+ *
+ * Return: the number of records read, -1 if the log is unusable
+ */
+static int index_load(Index *idx)
+{
+	GHashTable *counts;
+	char *data, *uri, *title, *term;
+	const char *p, *end, *record;
+	gsize size;
+	guint32 version, terms, frequency, length, i;
+	int n = 0;
+
+	if (!g_file_get_contents(idx->filename, &data, &size, NULL)) {
+		/* no log yet */
+		return 0;
+	}
+
+	version = 0;
+	if (size >= 8 && !memcmp(data, INDEX_MAGIC, 4)) {
+		memcpy(&version, data + 4, 4);
+		version = GUINT32_FROM_LE(version);
+	}
+	if (version != INDEX_VERSION) {
+		print_err("ignoring index file \"%s\" of unknown format\n", idx->filename);
+		g_free(data);
+		return -1;
+	}
+
+	for (p = data + 8, end = data + size; p < end; n++) {
+		record = p;
+		title = NULL;
+		if (!(uri = read_string(&p, end)) || !(title = read_string(&p, end))
+				|| !read_uint32(&p, end, &terms)) {
+			goto truncated;
+		}
+
+		counts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+		for (i = 0, length = 0; i < terms; i++) {
+			if (!(term = read_string(&p, end)) || !read_uint32(&p, end, &frequency)) {
+				g_free(term);
+				g_hash_table_destroy(counts);
+				goto truncated;
+			}
+			g_hash_table_replace(counts, term, GUINT_TO_POINTER(frequency));
+			length += frequency;
+		}
+
+		g_mutex_lock(&idx->lock);
+		index_insert(idx, strdup(uri), *title ? strdup(title) : NULL, counts, length);
+		g_mutex_unlock(&idx->lock);
+
+		g_hash_table_destroy(counts);
+		g_free(uri);
+		g_free(title);
+	}
+
+	g_free(data);
+	idx->records = n;
+	return n;
+
+truncated:
+	/* an interrupted append - keep the records before it */
+	print_err("index file \"%s\" truncated after %d pages\n", idx->filename, n);
+	if (truncate(idx->filename, record - data) == -1) {
+		print_err("unable to repair index file \"%s\"\n", idx->filename);
+	}
+	g_free(uri);
+	g_free(title);
+	g_free(data);
+	idx->records = n;
+	return n;
+}
+
+/*
+ * append a record to the log, starting a new one with a header if needed
+ */
+static void index_append(Index *idx, const char *uri, const char *title, GHashTable *counts)
+{
+	FILE *fp;
+	GString *data;
+	guint32 version = GUINT32_TO_LE(INDEX_VERSION);
+	gboolean create = idx->fresh || !g_file_test(idx->filename, G_FILE_TEST_EXISTS);
+
+	data = g_string_new(NULL);
+	append_record(data, uri, title, counts);
+	idx->fresh = FALSE;
+	idx->records++;
+
+	if (!(fp = fopen(idx->filename, create ? "wb" : "ab"))) {
+		print_err("unable to open index file \"%s\"\n", idx->filename);
+		g_string_free(data, TRUE);
+		return;
+	}
+
+	if (create) {
+		fwrite(INDEX_MAGIC, 1, 4, fp);
+		fwrite(&version, 4, 1, fp);
+	}
+	if (fwrite(data->str, 1, data->len, fp) != data->len) {
+		print_err("unable to write index file \"%s\"\n", idx->filename);
+	}
+
+	if (fclose(fp)) {
+		print_err("unable to close index file \"%s\"\n", idx->filename);
+	}
+	g_string_free(data, TRUE);
+}
+
+/*
+ * drop the dead documents and their postings - called with the lock held
+ */
+static void index_rebuild(Index *idx)
+{
+	GPtrArray *documents;
+	GHashTableIter iter;
+	gpointer value;
+	GArray *postings;
+	Posting *posting;
+	Document *d;
+	guint32 *ids, i, j;
+
+	/* new doc ids, G_MAXUINT32 for dead documents */
+	ids = g_new(guint32, idx->documents->len);
+	documents = g_ptr_array_new_with_free_func((GDestroyNotify)document_free);
+	g_hash_table_remove_all(idx->uris);
+
+	for (i = 0; i < idx->documents->len; i++) {
+		d = g_ptr_array_index(idx->documents, i);
+		if (!d->live) {
+			ids[i] = G_MAXUINT32;
+			document_free(d);
+			continue;
+		}
+		ids[i] = documents->len;
+		g_ptr_array_add(documents, d);
+		g_hash_table_insert(idx->uris, d->uri, GUINT_TO_POINTER(documents->len));
+	}
+
+	/* the documents moved to the new array */
+	g_ptr_array_set_free_func(idx->documents, NULL);
+	g_ptr_array_free(idx->documents, TRUE);
+	idx->documents = documents;
+
+	g_hash_table_iter_init(&iter, idx->terms);
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		postings = value;
+		for (i = 0, j = 0; i < postings->len; i++) {
+			posting = &g_array_index(postings, Posting, i);
+			if (ids[posting->doc] != G_MAXUINT32) {
+				posting->doc = ids[posting->doc];
+				g_array_index(postings, Posting, j++) = *posting;
+			}
+		}
+		if (!j) {
+			g_hash_table_iter_remove(&iter);
+		} else {
+			g_array_set_size(postings, j);
+		}
+	}
+
+	g_free(ids);
+}
+
+/*
+ * drop the dead documents from memory and rewrite the log with only the
+ * live ones
+ */
+static void index_compact(Index *idx)
+{
+	GHashTable **counts;
+	GHashTableIter iter;
+	gpointer term, value;
+	GArray *postings;
+	Posting *posting;
+	Document *d;
+	GString *data;
+	guint32 version = GUINT32_TO_LE(INDEX_VERSION), i;
+
+	if (idx->documents->len > idx->live) {
+		g_mutex_lock(&idx->lock);
+		index_rebuild(idx);
+		g_mutex_unlock(&idx->lock);
+	}
+
+	counts = g_new0(GHashTable *, idx->documents->len);
+
+	g_hash_table_iter_init(&iter, idx->terms);
+	while (g_hash_table_iter_next(&iter, &term, &value)) {
+		postings = value;
+		for (i = 0; i < postings->len; i++) {
+			posting = &g_array_index(postings, Posting, i);
+			if (!((Document *)g_ptr_array_index(idx->documents, posting->doc))->live) {
+				continue;
+			}
+			if (!counts[posting->doc]) {
+				counts[posting->doc] = g_hash_table_new(g_str_hash, g_str_equal);
+			}
+			g_hash_table_insert(counts[posting->doc], term, GUINT_TO_POINTER(posting->frequency));
+		}
+	}
+
+	data = g_string_new(INDEX_MAGIC);
+	g_string_append_len(data, (char *)&version, 4);
+	for (i = 0; i < idx->documents->len; i++) {
+		if (!counts[i]) {
+			continue;
+		}
+		d = g_ptr_array_index(idx->documents, i);
+		append_record(data, d->uri, d->title, counts[i]);
+		g_hash_table_destroy(counts[i]);
+	}
+	g_free(counts);
+
+	/* replaced atomically, through a temporary file */
+	if (!g_file_set_contents(idx->filename, data->str, data->len, NULL)) {
+		print_err("unable to compact index file \"%s\"\n", idx->filename);
+	} else {
+		idx->records = idx->live;
+		idx->fresh = FALSE;
+	}
+	g_string_free(data, TRUE);
+}
+
+/*
+ * remove uri from the index and log its removal
+ */
+static void index_remove_uri(Index *idx, const char *uri)
+{
+	GHashTable *none;
+
+	if (!g_hash_table_contains(idx->uris, uri)) {
+		return;
+	}
+
+	none = g_hash_table_new(g_str_hash, g_str_equal);
+	index_append(idx, uri, NULL, none);
+	g_hash_table_destroy(none);
+
+	g_mutex_lock(&idx->lock);
+	index_delete(idx, uri);
+	g_mutex_unlock(&idx->lock);
+}
+
+/*
+ * Return: TRUE if stale records make up more than half of the log - the
+ * dead documents in memory are never more than those
+ */
+static gboolean index_stale(Index *idx)
+{
+	return idx->records - idx->live > MAX(idx->live, MIN_COMPACT);
+}
+
+/*
+ * only this thread changes the index, so it reads it without the lock
+ */
+static gpointer index_run(gpointer data)
+{
+	Index *idx = data;
+	IndexJob *job;
+	GHashTable *counts;
+	Document *d;
+	guint32 length, i;
+
+	/* an unusable log is started over */
+	idx->fresh = index_load(idx) < 0;
+
+	if (index_stale(idx)) {
+		index_compact(idx);
+	}
+
+	while ((job = g_async_queue_pop(idx->queue))->type != JOB_STOP) {
+		switch (job->type) {
+		case JOB_ADD:
+			counts = tokenize_text(job->text, &length);
+			if (!g_hash_table_size(counts)) {
+				/* nothing to search for */
+				index_remove_uri(idx, job->uri);
+				g_hash_table_destroy(counts);
+				break;
+			}
+			index_append(idx, job->uri, job->title, counts);
+
+			g_mutex_lock(&idx->lock);
+			index_insert(idx, job->uri, job->title, counts, length);
+			g_mutex_unlock(&idx->lock);
+
+			/* now owned by the index */
+			job->uri = job->title = NULL;
+			g_hash_table_destroy(counts);
+			break;
+		case JOB_REMOVE:
+			index_remove_uri(idx, job->uri);
+			break;
+		case JOB_RETAIN:
+			for (i = 0; i < idx->documents->len; i++) {
+				d = g_ptr_array_index(idx->documents, i);
+				if (d->live && !g_hash_table_contains(job->uris, d->uri)) {
+					index_remove_uri(idx, d->uri);
+				}
+			}
+			break;
+		case JOB_TRIM:
+			if (idx->records > idx->live) {
+				index_compact(idx);
+			}
+			break;
+		}
+		job_free(job);
+
+		if (index_stale(idx)) {
+			index_compact(idx);
+		}
+	}
+	job_free(job);
+
+	return NULL;
+}
+
+/*
+ * open the index logged to filename, it is loaded in the background
+ */
+Index *index_new(const char *filename)
+{
+	Index *idx = emalloc(sizeof *idx);
+
+	idx->filename = strdup(filename);
+	idx->queue = g_async_queue_new();
+	g_mutex_init(&idx->lock);
+	idx->documents = g_ptr_array_new_with_free_func((GDestroyNotify)document_free);
+	idx->uris = g_hash_table_new(g_str_hash, g_str_equal);
+	idx->terms = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)postings_free);
+	idx->live = idx->records = 0;
+	idx->fresh = FALSE;
+	idx->thread = g_thread_new("index", index_run, idx);
+
+	return idx;
+}
+
+/*
+ * queue a page for indexing, the strings are copied
+ */
+void index_add(Index *idx, const char *uri, const char *title, const char *text)
+{
+	IndexJob *job = job_new(JOB_ADD);
+
+	job->uri = strdup(uri);
+	job->title = (title && *title) ? strdup(title) : NULL;
+	job->text = strconcat(title ? title : "", " ", text, NULL);
+
+	g_async_queue_push(idx->queue, job);
+}
+
+/*
+ * queue the removal of the page at uri
+ */
+void index_remove(Index *idx, const char *uri)
+{
+	IndexJob *job = job_new(JOB_REMOVE);
+
+	job->uri = strdup(uri);
+	g_async_queue_push(idx->queue, job);
+}
+
+/*
+ * queue the removal of every page whose uri is not in uris, a set that is
+ * taken over and freed by the index
+ */
+void index_retain(Index *idx, GHashTable *uris)
+{
+	IndexJob *job = job_new(JOB_RETAIN);
+
+	job->uris = uris;
+	g_async_queue_push(idx->queue, job);
+}
+
+/*
+ * queue dropping the removed pages from memory and from the log
+ */
+void index_trim(Index *idx)
+{
+	g_async_queue_push(idx->queue, job_new(JOB_TRIM));
+}
+
+static gint result_compare(gconstpointer a, gconstpointer b)
+{
+	double d = ((const IndexResult *)b)->score - ((const IndexResult *)a)->score;
+
+	return (d > 0) - (d < 0);
+}
+
+/*
+ * rank the pages containing any of the terms in query by the sum of
+ * tf-idf over the terms
+ *
+ * Return: list of at most max IndexResults, best first
+ */
+GList *index_search(Index *idx, const char *query, int max)
+{
+	GHashTable *counts;
+	GHashTableIter iter;
+	gpointer term;
+	GArray *postings;
+	Posting *posting;
+	Document *d;
+	IndexResult *r;
+	GList *results = NULL, *link;
+	double *scores, idf;
+	guint32 length, df, i;
+
+	counts = tokenize_text(query, &length);
+
+	g_mutex_lock(&idx->lock);
+
+	scores = g_new0(double, idx->documents->len + 1);
+
+	g_hash_table_iter_init(&iter, counts);
+	while (g_hash_table_iter_next(&iter, &term, NULL)) {
+		if (!(postings = g_hash_table_lookup(idx->terms, term))) {
+			continue;
+		}
+
+		for (i = 0, df = 0; i < postings->len; i++) {
+			posting = &g_array_index(postings, Posting, i);
+			df += ((Document *)g_ptr_array_index(idx->documents, posting->doc))->live;
+		}
+		if (!df) {
+			continue;
+		}
+
+		idf = log(1.0 + (double)idx->live / df);
+		for (i = 0; i < postings->len; i++) {
+			posting = &g_array_index(postings, Posting, i);
+			d = g_ptr_array_index(idx->documents, posting->doc);
+			if (d->live) {
+				scores[posting->doc] += idf * posting->frequency / d->length;
+			}
+		}
+	}
+
+	for (i = 0; i < idx->documents->len; i++) {
+		if (scores[i] <= 0.0) {
+			continue;
+		}
+		d = g_ptr_array_index(idx->documents, i);
+		r = emalloc(sizeof *r);
+		r->uri = strdup(d->uri);
+		r->title = d->title ? strdup(d->title) : NULL;
+		r->score = scores[i];
+		results = g_list_prepend(results, r);
+	}
+
+	g_mutex_unlock(&idx->lock);
+
+	g_free(scores);
+	g_hash_table_destroy(counts);
+
+	/* keep the best max */
+	results = g_list_sort(results, result_compare);
+	if (max > 0 && (link = g_list_nth(results, max))) {
+		link->prev->next = NULL;
+		link->prev = NULL;
+		g_list_free_full(link, (GDestroyNotify)index_result_free);
+	}
+
+	return results;
+}
+
+/*
+ * Return: the number of indexed pages
+ */
+unsigned int index_size(Index *idx)
+{
+	unsigned int live;
+
+	g_mutex_lock(&idx->lock);
+	live = idx->live;
+	g_mutex_unlock(&idx->lock);
+
+	return live;
+}
+
+void index_result_free(IndexResult *r)
+{
+	free(r->uri);
+	free(r->title);
+	free(r);
+}
+
+/*
+ * index the queued pages and stop the worker
+ */
+void index_free(Index *idx)
+{
+	if (!idx) {
+		return;
+	}
+
+	g_async_queue_push(idx->queue, job_new(JOB_STOP));
+	g_thread_join(idx->thread);
+
+	g_async_queue_unref(idx->queue);
+	g_mutex_clear(&idx->lock);
+	g_hash_table_destroy(idx->uris);
+	g_hash_table_destroy(idx->terms);
+	g_ptr_array_free(idx->documents, TRUE);
+	free(idx->filename);
+	free(idx);
+}
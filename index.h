@@ -0,0 +1,29 @@
+#ifndef __INDEX_H__
+#define __INDEX_H__
+
+/*
+ * full-text index of visited pages: documents are tokenized and added on
+ * a worker thread and appended to an on-disk log that is replayed at
+ * startup and compacted, with the index in memory, once replaced and
+ * removed pages make up half of it. Searches rank pages by tf-idf
+ */
+typedef struct _Index Index;
+typedef struct _IndexResult IndexResult;
+
+struct _IndexResult {
+	char *uri;
+	char *title;
+	double score;
+};
+
+Index *index_new(const char *filename);
+void index_add(Index *idx, const char *uri, const char *title, const char *text);
+void index_remove(Index *idx, const char *uri);
+void index_retain(Index *idx, GHashTable *uris);
+void index_trim(Index *idx);
+GList *index_search(Index *idx, const char *query, int max);
+unsigned int index_size(Index *idx);
+void index_result_free(IndexResult *r);
+void index_free(Index *idx);
+
+#endif /* __INDEX_H__ */
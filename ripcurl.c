@@ -2,16 +2,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
+#include <signal.h>
 
 #include <gtk/gtk.h>
 #include <gdk/gdkkeysyms.h>
+#include <glib-unix.h>
 #include <webkit/webkit.h>
+#define LIBSOUP_USE_UNSTABLE_REQUEST_API
+#include <libsoup/soup-cache.h>
 
 #include "utils.h"
+#include "stats.h"
+#include "blocklist.h"
+#include "writer.h"
+#include "history.h"
+#include "index.h"
 
 /* macros */
 #define LENGTH(x)		(sizeof x / sizeof x[0])
 #define ALL_MASK		(GDK_CONTROL_MASK | GDK_SHIFT_MASK | GDK_MOD1_MASK)
+#define REPLAY_LOAD_TIMEOUT	30	/* seconds to wait for a recorded page load */
+#define PREFETCH_TTL		300	/* seconds until an unused prefetch counts as wasted */
+#define SUSPEND_INTERVAL	10	/* seconds between idle window checks */
+#define MEMORY_INTERVAL		5	/* seconds between memory usage checks */
+#define INDEX_MAX_TEXT		262144	/* bytes of a page's text that are indexed */
+#define HSEARCH_RESULTS		50
 
 /* enums */
 enum {
@@ -25,6 +41,9 @@ enum {
 	ZOOM_RESET,
 	DELETE_CHAR,
 	APPEND_URL,
+	AUTO,
+	ON,
+	OFF,
 };
 
 /* modes */
@@ -41,6 +60,11 @@ typedef struct _Command Command;
 typedef struct _SpecialCommand SpecialCommand;
 typedef struct _Ripcurl Ripcurl;
 typedef struct _Browser Browser;
+typedef struct _ReplayEvent ReplayEvent;
+typedef struct _Preconnection Preconnection;
+typedef struct _SiteRule SiteRule;
+typedef struct _SiteNode SiteNode;
+typedef struct _ProfilePhase ProfilePhase;
 
 struct _Arg {
 	int n;
@@ -74,14 +98,32 @@ struct _SpecialCommand {
 	const Arg arg;
 };
 
+/* a timed startup phase, times in us */
+struct _ProfilePhase {
+	const char *name;
+	gboolean worker;
+	gint64 start;		/* since main() was entered */
+	gint64 wall;
+	gint64 cpu;			/* of the thread that ran the phase */
+};
+
 struct _Ripcurl {
 	struct {
 		GList *browsers;
 		GList *bookmarks;
-		GList *history;
+		History *history;
 		GList *command_history;
 		WebKitWebSettings *webkit_settings;
 		SoupSession *soup_session;
+		SoupCache *soup_cache;
+		guint cache_dump;
+		GNetworkMonitor *network_monitor;
+		gboolean offline;
+		int offline_mode;
+		guint suspend_check;
+		Blocklist *blocklist;
+		Writer *writer;
+		Index *index;
 		GdkKeymap *keymap;
 	} Global;
 
@@ -90,6 +132,9 @@ struct _Ripcurl {
 		char *bookmarks_file;
 		char *history_file;
 		char *cookie_file;
+		char *cache_dir;
+		char *session_file;
+		char *index_file;
 	} Files;
 
 	struct {
@@ -105,6 +150,116 @@ struct _Ripcurl {
 		GdkColor notification_e_fg;
 		PangoFontDescription *font;
 	} Style;
+
+	struct {
+		GHashTable *latency;
+		unsigned long cache_hits;
+		unsigned long cache_revalidated;
+		unsigned long cache_misses;
+		unsigned long preconnect_issued;
+		unsigned long preconnect_deduplicated;
+		unsigned long preconnect_limited;
+		unsigned long preconnect_hits;
+		unsigned long preconnect_misses;
+		unsigned long prefetch_issued;
+		unsigned long prefetch_used;
+		unsigned long prefetch_wasted;
+		unsigned long prefetch_cancelled;
+		unsigned long prefetch_limited;
+		unsigned long blocked;
+		Histogram *blocklist_check;
+		unsigned long suspended_idle;
+		unsigned long suspended_budget;
+		unsigned long suspended_memory;
+		unsigned long resumed;
+		unsigned long spare_hits;
+		unsigned long spare_misses;
+		Histogram *window_time;
+	} Stats;
+
+	struct {
+		GHashTable *origins;
+		double tokens;
+		gint64 refill;
+		char *startup;		/* https uri waiting for the ca database */
+	} Preconnect;
+
+	struct {
+		GHashTable *uris;
+		gint64 window;
+		goffset bytes;
+	} Prefetch;
+
+	struct {
+		SiteNode *root;
+		GHashTable *settings;
+		GHashTable *lite;	/* settings -> their lite mode copy */
+	} Sites;
+
+	struct {
+		gboolean closed;
+	} Session;
+
+	struct {
+		guint timer;
+		gboolean session;		/* changed since last written */
+		gboolean history;
+		gboolean bookmarks;
+	} Autosave;
+
+	struct {
+		Browser *browser;	/* hidden, not in the list of browsers */
+		guint idle;
+	} Spare;
+
+	struct {
+		gboolean enabled;
+		gboolean reported;
+		gboolean painted;
+		gint64 start;
+		GThread *main_thread;
+		GMutex lock;
+		GArray *phases;
+		ProfilePhase first_paint;
+	} Profile;
+
+	struct {
+		GMutex lock;
+		GCond loaded;		/* signalled by the workers */
+		int pending;		/* loads not merged yet, main thread only */
+		GTlsDatabase *tls_database;
+		gboolean tls_ready;
+		gboolean tls_applied;
+		SoupCookieJar *cookie_jar;
+		gboolean cookies_ready;
+		gboolean cookies_applied;
+		gboolean history_legacy;	/* history file is in the flat format */
+	} Load;
+
+	struct {
+		guint timer;
+		int level;		/* 0: normal, 1: over the soft limit, 2: over the hard limit */
+		WebKitCacheModel cache_model;
+		gboolean page_cache;
+		goffset peak;
+		unsigned long trims;
+	} Memory;
+
+	struct {
+		FILE *file;
+		gint64 start;
+	} Record;
+
+	struct {
+		GList *events;
+		GList *next;
+		double speed;
+		int loads;
+		guint timeout;
+		gboolean waiting;
+		gboolean timed_out;
+		gint64 start;
+	} Replay;
 };
 
 struct _Browser {
@@ -113,6 +268,11 @@ struct _Browser {
 		int progress;
 		gboolean ssl;
 		gboolean inspecting;
+		gint64 key_time;
+		gint64 load_start;
+		gint64 window_start;
+		gboolean stale;
+		gboolean lite;
 	} State;
 
 	struct {
@@ -122,6 +282,7 @@ struct _Browser {
 		GtkScrolledWindow *scrolled_window;
 		WebKitWebView *view;
 		WebKitWebInspector *inspector;
+		GtkWidget *placeholder;
 		GtkWidget *statusbar;
 		GtkBox *statusbar_entries;
 		GtkEntry *inputbar;
@@ -132,6 +293,49 @@ struct _Browser {
 		GtkLabel *buffer;
 		GtkLabel *position;
 	} Statusbar;
+
+	struct {
+		char *uri;
+		guint timer;
+		SoupMessage *message;
+	} Hover;
+
+	struct {
+		gboolean suspended;
+		gboolean restore_scroll;
+		gint64 active_time;
+		char *uri;
+		double scroll_x;
+		double scroll_y;
+		GList *history;
+		WebKitWebHistoryItem *current;
+	} Suspend;
+};
+
+/* settings for a host, or with "*." for a domain and its subdomains */
+struct _SiteRule {
+	char *host;
+	int scripts;
+	int images;
+	int plugins;
+};
+
+/* host trie node, one label per level starting at the top level domain */
+struct _SiteNode {
+	GHashTable *children;
+	SiteRule *exact;
+	SiteRule *subtree;
+};
+
+struct _Preconnection {
+	gint64 time;
+	gboolean used;
+};
+
+struct _ReplayEvent {
+	gint64 time;
+	char *type;
+	char *data;
 };
 
 Ripcurl *ripcurl;
@@ -157,12 +361,17 @@ void isc_input_manipulation(Browser *b, const Arg *arg);
 /* commands */
 gboolean cmd_back(Browser *b, int argc, char **argv);
 gboolean cmd_bookmark(Browser *b, int argc, char **argv);
+gboolean cmd_cache(Browser *b, int argc, char **argv);
 gboolean cmd_forward(Browser *b, int argc, char **argv);
+gboolean cmd_hsearch(Browser *b, int argc, char **argv);
+gboolean cmd_lite(Browser *b, int argc, char **argv);
+gboolean cmd_offline(Browser *b, int argc, char **argv);
 gboolean cmd_open(Browser *b, int argc, char **argv);
 gboolean cmd_print(Browser *b, int argc, char **argv);
 gboolean cmd_quit(Browser *b, int argc, char **argv);
 gboolean cmd_reload(Browser *b, int argc, char **argv);
 gboolean cmd_quitall(Browser *b, int argc, char **argv);
+gboolean cmd_stats(Browser *b, int argc, char **argv);
 gboolean cmd_winopen(Browser *b, int argc, char **argv);
 
 /* special commands */
@@ -170,6 +379,8 @@ gboolean scmd_search(Browser *b, char *input, const Arg *arg, gboolean activate)
 
 /* callbacks */
 void cb_win_destroy(GtkWidget *widget, Browser *b);
+gboolean cb_win_focus(GtkWidget *widget, GdkEventFocus *event, Browser *b);
+gboolean cb_win_map(GtkWidget *widget, GdkEvent *event, Browser *b);
 
 gboolean cb_wv_console_message(WebKitWebView *view, char *message, int line, char *source_id, Browser *b);
 gboolean cb_wv_keypress(GtkWidget *widget, GdkEventKey *event, Browser *b);
@@ -179,9 +390,12 @@ void cb_wv_notify_progress(WebKitWebView *view, GParamSpec *pspec, Browser *b);
 void cb_wv_notify_title(WebKitWebView *view, GParamSpec *pspec, Browser *b);
 void cb_wv_hover_link(WebKitWebView *view, char *title, char *uri, Browser *b);
 gboolean cb_wv_mime_type_decision(WebKitWebView *view, WebKitWebFrame *frame, WebKitNetworkRequest *request, char *mimetype, WebKitWebPolicyDecision *policy_decision, Browser *b);
+gboolean cb_wv_navigation_decision(WebKitWebView *view, WebKitWebFrame *frame, WebKitNetworkRequest *request, WebKitWebNavigationAction *action, WebKitWebPolicyDecision *policy_decision, Browser *b);
+void cb_wv_resource_request_starting(WebKitWebView *view, WebKitWebFrame *frame, WebKitWebResource *resource, WebKitNetworkRequest *request, WebKitNetworkResponse *response, Browser *b);
 gboolean cb_wv_download_requested(WebKitWebView *view, WebKitDownload *download, Browser *b);
 void cb_download_notify_status(WebKitDownload *download, GParamSpec *pspec, Browser *b);
 void cb_wv_scrolled(GtkAdjustment *adjustment, Browser *b);
+gboolean cb_wv_first_paint(GtkWidget *widget, GdkEventExpose *event, Browser *b);
 
 WebKitWebView *cb_inspector_new(WebKitWebInspector *inspector, WebKitWebView *view, Browser *b);
 gboolean cb_inspector_show(WebKitWebInspector *inspector, Browser *b);
@@ -192,10 +406,29 @@ gboolean cb_inputbar_keypress(GtkWidget *widget, GdkEventKey *event, Browser *b)
 void cb_inputbar_changed(GtkEntry *entry, Browser *b);
 void cb_inputbar_activate(GtkEntry *entry, Browser *b);
 
+void cb_soup_request_queued(SoupSession *session, SoupMessage *message, gpointer data);
+void cb_soup_request_started(SoupSession *session, SoupMessage *message, SoupSocket *socket, gpointer data);
+void cb_soup_request_unqueued(SoupSession *session, SoupMessage *message, gpointer data);
+
+void cb_soup_prefetch_got_headers(SoupMessage *message, gpointer data);
+void cb_soup_prefetch_got_chunk(SoupMessage *message, SoupBuffer *chunk, gpointer data);
+void cb_soup_prefetch_finished(SoupSession *session, SoupMessage *message, gpointer data);
+
+void cb_network_changed(GNetworkMonitor *monitor, gboolean available, gpointer data);
+
+void cb_tls_loaded(GObject *source, GAsyncResult *result, gpointer data);
+void cb_cookies_loaded(GObject *source, GAsyncResult *result, gpointer data);
+void cb_bookmarks_loaded(GObject *source, GAsyncResult *result, gpointer data);
+void cb_history_loaded(GObject *source, GAsyncResult *result, gpointer data);
+void cb_blocklist_loaded(GObject *source, GAsyncResult *result, gpointer data);
+
 /* browser functions */
 Browser *browser_new(void);
+Browser *browser_build(gboolean view);
+void browser_view_new(Browser *b);
 void browser_show(Browser * b);
 void browser_apply_settings(Browser *b);
+void browser_set_settings(Browser *b, const char *uri);
 char *browser_get_uri(Browser *b);
 void browser_change_mode(Browser *b, int mode);
 void browser_nav_history(Browser *b, int direction);
@@ -208,16 +441,127 @@ void browser_zoom(Browser * b, int mode);
 void browser_update_uri(Browser *b);
 void browser_update_position(Browser *b);
 void browser_update(Browser *b);
+gboolean browser_hover_timeout(gpointer data);
+GList *browser_get_history(Browser *b, WebKitWebHistoryItem **current);
+void browser_suspend(Browser *b);
+void browser_unload(Browser *b);
+void browser_placeholder(Browser *b);
+void browser_resume(Browser *b);
 void browser_destroy(Browser * b);
 
+/* window suspension functions */
+gboolean suspend_check(gpointer data);
+Browser *suspend_lru(Browser *keep);
+
+/* spare window functions */
+void spare_schedule(void);
+gboolean spare_fill(gpointer data);
+void spare_drop(void);
+
 /* bookmark functions */
 void bookmarks_read(void);
 void bookmarks_write(void);
 
 /* history functions */
-void history_add(char *uri);
+void history_add(char *uri, const char *title);
 void history_read(void);
 void history_write(void);
+void history_index_page(Browser *b);
+void history_evicted(gpointer entry, gpointer data);
+void history_collect_uri(gpointer entry, gpointer uris);
+void history_index_sync(void);
+
+/* startup load functions */
+void load_start(GTaskThreadFunc func, GAsyncReadyCallback callback);
+void load_done(void);
+void load_ready(gboolean *ready);
+void load_wait(gboolean *ready);
+GList *load_merge(GList *list, GList *loaded);
+void tls_load(GTask *task, gpointer source, gpointer data, GCancellable *cancellable);
+void tls_apply(void);
+void cookies_load(GTask *task, gpointer source, gpointer data, GCancellable *cancellable);
+void cookies_apply(void);
+void cookies_migrate(SoupCookieJar *jar);
+void bookmarks_load(GTask *task, gpointer source, gpointer data, GCancellable *cancellable);
+void history_load(GTask *task, gpointer source, gpointer data, GCancellable *cancellable);
+void blocklist_load_files(GTask *task, gpointer source, gpointer data, GCancellable *cancellable);
+
+/* session functions */
+void session_write(void);
+int session_restore(gboolean focus);
+
+/* autosave functions */
+gboolean autosave(gpointer data);
+gboolean cb_signal_quit(gpointer data);
+
+/* cache functions */
+void cache_schedule_dump(void);
+gboolean cache_dump(gpointer data);
+
+/* offline functions */
+void offline_set(gboolean offline);
+
+/* preconnect functions */
+char *uri_origin(const char *uri);
+gboolean uri_is_font(const char *uri);
+void preconnect(const char *uri, gboolean limit);
+void preconnect_navigated(const char *uri);
+void preconnect_startup(const char *uri);
+void preconnect_startup_connect(void);
+
+/* prefetch functions */
+gboolean prefetch_start(Browser *b);
+goffset prefetch_budget_left(void);
+void prefetch_limit(SoupMessage *message);
+void prefetch_cancel(Browser *b);
+void prefetch_navigated(const char *uri);
+void prefetch_expire(void);
+
+/* memory functions */
+gboolean memory_check(gpointer data);
+void memory_trim(goffset rss);
+void memory_restore(void);
+void memory_set_page_cache(gboolean enable);
+
+/* site settings functions */
+SiteNode *site_node_new(void);
+void site_node_free(SiteNode *node);
+void sites_init(void);
+SiteRule *sites_lookup(const char *uri);
+WebKitWebSettings *sites_settings(SiteRule *rule);
+WebKitWebSettings *sites_lite_settings(WebKitWebSettings *settings);
+
+/* statistics functions */
+gint64 stats_event_time(GdkEventKey *event);
+void stats_record_latency(char *action, gint64 start);
+void stats_print_latency(void);
+void stats_print_preconnect(void);
+void stats_print_prefetch(void);
+void stats_print_blocklist(void);
+void stats_print_suspend(void);
+void stats_print_memory(void);
+void stats_print_window(void);
+
+/* startup profile functions */
+void profile_init(gboolean enabled, gint64 start);
+gint64 profile_cpu_time(void);
+void profile_begin(ProfilePhase *phase, const char *name);
+void profile_end(ProfilePhase *phase);
+void profile_report(void);
+void profile_check(void);
+gint profile_compare(gconstpointer a, gconstpointer b);
+
+/* record and replay functions */
+void record_start(char *filename);
+void record_event(char *type, char *data);
+void record_key(char *type, GdkEventKey *event);
+void record_stop(void);
+void replay_start(char *filename, double speed);
+gboolean replay_next(gpointer data);
+gboolean replay_load_timeout(gpointer data);
+void replay_key(Browser *b, char *data);
+void replay_load_finished(void);
+void replay_stop(void);
 
 /* init, cleanup, and data */
 void ripcurl_init(void);
@@ -418,12 +762,37 @@ gboolean cmd_bookmark(Browser *b, int argc, char **argv)
 	}
 
 	ripcurl->Global.bookmarks = g_list_prepend(ripcurl->Global.bookmarks, bookmark);
+	ripcurl->Autosave.bookmarks = TRUE;
 
 	free(uri);
 
 	return TRUE;
 }
 
+gboolean cmd_cache(Browser *b, int argc, char **argv)
+{
+	unsigned long hits, total;
+	char *text;
+
+	if (!ripcurl->Global.soup_cache) {
+		browser_notify(b, DEFAULT, "Cache disabled");
+		return FALSE;
+	}
+
+	hits = ripcurl->Stats.cache_hits + ripcurl->Stats.cache_revalidated;
+	total = hits + ripcurl->Stats.cache_misses;
+
+	asprintf(&text, "Cache: %.0f%% hits (%lu fresh, %lu revalidated, %lu fetched), %.1f/%.1f MiB",
+			total ? 100.0 * hits / total : 0.0,
+			ripcurl->Stats.cache_hits, ripcurl->Stats.cache_revalidated, ripcurl->Stats.cache_misses,
+			dir_size(ripcurl->Files.cache_dir) / 1048576.0,
+			soup_cache_get_max_size(ripcurl->Global.soup_cache) / 1048576.0);
+	browser_notify(b, DEFAULT, text);
+	free(text);
+
+	return FALSE;
+}
+
 gboolean cmd_forward(Browser *b, int argc, char **argv)
 {
 	browser_nav_history(b, NEXT);
@@ -431,6 +800,111 @@ gboolean cmd_forward(Browser *b, int argc, char **argv)
 	return TRUE;
 }
 
+/*
+ * show the indexed pages best matching the terms
+ */
+gboolean cmd_hsearch(Browser *b, int argc, char **argv)
+{
+	GList *results, *list;
+	IndexResult *r;
+	GString *html;
+	char *query, *escaped, *uri;
+	gint64 start;
+
+	if (!ripcurl->Global.index) {
+		browser_notify(b, ERROR, "History index is disabled");
+		return FALSE;
+	}
+	if (argc <= 0) {
+		browser_notify(b, ERROR, "Usage: hsearch terms");
+		return FALSE;
+	}
+
+	query = strjoinv(argv, " ");
+	start = g_get_monotonic_time();
+	results = index_search(ripcurl->Global.index, query, HSEARCH_RESULTS);
+
+	escaped = g_markup_escape_text(query, -1);
+	html = g_string_new(NULL);
+	g_string_append_printf(html, "<!DOCTYPE html><html><head><meta charset=\"utf-8\">"
+			"<title>hsearch: %s</title></head><body><p>%u results for <b>%s</b> in %.1f ms, "
+			"%u pages indexed</p><ol>", escaped, g_list_length(results), escaped,
+			(g_get_monotonic_time() - start) / 1000.0, index_size(ripcurl->Global.index));
+	g_free(escaped);
+
+	for (list = results; list; list = g_list_next(list)) {
+		r = list->data;
+		uri = g_markup_escape_text(r->uri, -1);
+		escaped = g_markup_escape_text(r->title ? r->title : r->uri, -1);
+		g_string_append_printf(html, "<li><a href=\"%s\">%s</a><br><small>%s</small></li>",
+				uri, escaped, uri);
+		g_free(escaped);
+		g_free(uri);
+	}
+	g_string_append(html, "</ol></body></html>");
+
+	webkit_web_view_load_string(b->UI.view, html->str, "text/html", "utf-8", "about:blank");
+
+	g_string_free(html, TRUE);
+	g_list_free_full(results, (GDestroyNotify)index_result_free);
+	free(query);
+
+	return TRUE;
+}
+
+gboolean cmd_lite(Browser *b, int argc, char **argv)
+{
+	if (argc <= 0) {
+		/* toggle */
+		b->State.lite = !b->State.lite;
+	} else if (!strcmp(argv[0], "on")) {
+		b->State.lite = TRUE;
+	} else if (!strcmp(argv[0], "off")) {
+		b->State.lite = FALSE;
+	} else {
+		browser_notify(b, ERROR, "Usage: lite [on|off]");
+		return FALSE;
+	}
+
+	browser_set_settings(b, browser_get_uri(b));
+	browser_reload(b, FALSE);
+
+	return TRUE;
+}
+
+gboolean cmd_offline(Browser *b, int argc, char **argv)
+{
+	if (!ripcurl->Global.soup_cache) {
+		browser_notify(b, ERROR, "Offline mode needs the cache");
+		return FALSE;
+	}
+
+	if (argc <= 0) {
+		/* toggle */
+		ripcurl->Global.offline_mode = !ripcurl->Global.offline;
+	} else if (!strcmp(argv[0], "on")) {
+		ripcurl->Global.offline_mode = TRUE;
+	} else if (!strcmp(argv[0], "off")) {
+		ripcurl->Global.offline_mode = FALSE;
+	} else if (!strcmp(argv[0], "auto")) {
+		ripcurl->Global.offline_mode = AUTO;
+	} else {
+		browser_notify(b, ERROR, "Usage: offline [on|off|auto]");
+		return FALSE;
+	}
+
+	if (ripcurl->Global.offline_mode == AUTO) {
+		offline_set(ripcurl->Global.network_monitor
+				&& !g_network_monitor_get_network_available(ripcurl->Global.network_monitor));
+	} else {
+		offline_set(ripcurl->Global.offline_mode);
+	}
+
+	browser_notify(b, DEFAULT, ripcurl->Global.offline ? "Offline" : "Online");
+
+	return FALSE;
+}
+
 gboolean cmd_open(Browser *b, int argc, char **argv)
 {
 	char *uri;
@@ -463,7 +937,10 @@ gboolean cmd_quit(Browser *b, int argc, char **argv)
 
 gboolean cmd_quitall(Browser *b, int argc, char **argv)
 {
-	
+	/* save all windows, not just the last one closed */
+	session_write();
+	ripcurl->Session.closed = TRUE;
+
 	while (ripcurl->Global.browsers) {
 		browser_destroy(ripcurl->Global.browsers->data);
 	}
@@ -478,6 +955,50 @@ gboolean cmd_reload(Browser *b, int argc, char **argv)
 	return TRUE;
 }
 
+gboolean cmd_stats(Browser *b, int argc, char **argv)
+{
+	char *section = (argc > 0) ? argv[0] : NULL;
+	gboolean found = FALSE;
+
+	if (!section || !strcmp(section, "latency")) {
+		stats_print_latency();
+		found = TRUE;
+	}
+	if (!section || !strcmp(section, "preconnect")) {
+		stats_print_preconnect();
+		found = TRUE;
+	}
+	if (!section || !strcmp(section, "prefetch")) {
+		stats_print_prefetch();
+		found = TRUE;
+	}
+	if (!section || !strcmp(section, "blocklist")) {
+		stats_print_blocklist();
+		found = TRUE;
+	}
+	if (!section || !strcmp(section, "suspend")) {
+		stats_print_suspend();
+		found = TRUE;
+	}
+	if (!section || !strcmp(section, "memory")) {
+		stats_print_memory();
+		found = TRUE;
+	}
+	if (!section || !strcmp(section, "window")) {
+		stats_print_window();
+		found = TRUE;
+	}
+
+	if (!found) {
+		browser_notify(b, ERROR, "Unknown statistics");
+		return FALSE;
+	}
+
+	browser_notify(b, DEFAULT, "Statistics written to stdout");
+
+	return FALSE;
+}
+
 gboolean cmd_winopen(Browser *b, int argc, char **argv)
 {
 	Browser *n = browser_new();
@@ -513,6 +1034,27 @@ void cb_win_destroy(GtkWidget * widget, Browser * b)
 	browser_destroy(b);
 }
 
+gboolean cb_win_focus(GtkWidget *widget, GdkEventFocus *event, Browser *b)
+{
+	/* windows are suspended by the time they were last focused */
+	b->Suspend.active_time = g_get_monotonic_time();
+	ripcurl->Autosave.session = TRUE;
+
+	if (event->in && b->Suspend.suspended) {
+		browser_resume(b);
+	}
+
+	return FALSE;
+}
+
+gboolean cb_win_map(GtkWidget *widget, GdkEvent *event, Browser *b)
+{
+	g_signal_handlers_disconnect_by_func(G_OBJECT(widget), G_CALLBACK(cb_win_map), b);
+	histogram_record(ripcurl->Stats.window_time, g_get_monotonic_time() - b->State.window_start);
+
+	return FALSE;
+}
+
 gboolean cb_wv_console_message(WebKitWebView *view, char *message, int line, char *source_id, Browser *b)
 {
 	if (!strcmp(message, "hintmode_off") || !strcmp(message, "insertmode_off")) {
@@ -529,6 +1071,11 @@ gboolean cb_wv_keypress(GtkWidget *widget, GdkEventKey *event, Browser *b)
 	unsigned int keyval;
 	GdkModifierType consumed_modifiers;
 	int i;
+	gint64 start;
+	char *action;
+
+	start = stats_event_time(event);
+	record_key("key", event);
 
 	gdk_keymap_translate_keyboard_state(
 			ripcurl->Global.keymap, event->hardware_keycode, event->state, event->group, /* in */
@@ -540,6 +1087,15 @@ gboolean cb_wv_keypress(GtkWidget *widget, GdkEventKey *event, Browser *b)
 				&& b->State.mode & shortcuts[i].mode
 				&& shortcuts[i].func) {
 			shortcuts[i].func(b, &(shortcuts[i].arg));
+
+			/* NOTE: b may have been destroyed by the shortcut */
+			asprintf(&action, "%s%s%s",
+					(shortcuts[i].mask & GDK_CONTROL_MASK) ? "C-" : "",
+					(shortcuts[i].mask & GDK_MOD1_MASK) ? "M-" : "",
+					gdk_keyval_name(shortcuts[i].keyval));
+			stats_record_latency(action, start);
+			free(action);
+
 			return TRUE;
 		}
 	}
@@ -563,6 +1119,22 @@ void cb_wv_hover_link(WebKitWebView *view, char *title, char *uri, Browser *b)
 	} else if ((text = webkit_web_view_get_uri(b->UI.view))) {
 		gtk_label_set_text(b->Statusbar.text, text);
 	}
+
+	/* restart hover timer */
+	if (b->Hover.timer) {
+		g_source_remove(b->Hover.timer);
+		b->Hover.timer = 0;
+	}
+	free(b->Hover.uri);
+	b->Hover.uri = NULL;
+
+	/* pointer left the link - prefetch is no longer wanted */
+	prefetch_cancel(b);
+
+	if (uri && (hover_preconnect || hover_prefetch) && !private_browsing) {
+		b->Hover.uri = strdup(uri);
+		b->Hover.timer = g_timeout_add(hover_delay, browser_hover_timeout, b);
+	}
 }
 
 gboolean cb_wv_mime_type_decision(WebKitWebView *view, WebKitWebFrame *frame, WebKitNetworkRequest *request, char *mimetype, WebKitWebPolicyDecision *policy_decision, Browser *b)
@@ -574,6 +1146,63 @@ gboolean cb_wv_mime_type_decision(WebKitWebView *view, WebKitWebFrame *frame, We
 	return FALSE;
 }
 
+gboolean cb_wv_navigation_decision(WebKitWebView *view, WebKitWebFrame *frame, WebKitNetworkRequest *request, WebKitWebNavigationAction *action, WebKitWebPolicyDecision *policy_decision, Browser *b)
+{
+	/*
+	 * the jar has to be in the session before the request is queued, soup
+	 * only hooks features into messages queued after they were added
+	 */
+	cookies_apply();
+
+	if (frame != webkit_web_view_get_main_frame(view)) {
+		return FALSE;
+	}
+
+	/* swap in the settings of the site being navigated to */
+	browser_set_settings(b, webkit_network_request_get_uri(request));
+
+	return FALSE;
+}
+
+void cb_wv_resource_request_starting(WebKitWebView *view, WebKitWebFrame *frame, WebKitWebResource *resource, WebKitNetworkRequest *request, WebKitNetworkResponse *response, Browser *b)
+{
+	const char *uri;
+	struct timespec start, end;
+	gboolean blocked;
+
+	if (!(uri = webkit_network_request_get_uri(request)) || strncmp(uri, "http", 4)) {
+		return;
+	}
+
+	/* never block the page the user navigated to */
+	if (frame == webkit_web_view_get_main_frame(view)
+			&& webkit_web_frame_get_load_status(frame) == WEBKIT_LOAD_PROVISIONAL) {
+		return;
+	}
+
+	/* no web fonts in lite mode, webkit has no setting for them */
+	if (b->State.lite && uri_is_font(uri)) {
+		webkit_network_request_set_uri(request, "about:blank");
+		return;
+	}
+
+	if (!ripcurl->Global.blocklist) {
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	blocked = blocklist_match(ripcurl->Global.blocklist, uri);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	histogram_record(ripcurl->Stats.blocklist_check,
+			(end.tv_sec - start.tv_sec) * G_GINT64_CONSTANT(1000000000) + (end.tv_nsec - start.tv_nsec));
+
+	if (blocked) {
+		ripcurl->Stats.blocked++;
+		webkit_network_request_set_uri(request, "about:blank");
+	}
+}
+
 gboolean cb_wv_download_requested(WebKitWebView *view, WebKitDownload *download, Browser *b)
 {
 	const char *suggested_filename = webkit_download_get_suggested_filename(download);
@@ -626,10 +1255,30 @@ void cb_wv_notify_load_status(WebKitWebView *view, GParamSpec *pspec, Browser *b
 	WebKitWebDataSource *source;
 	WebKitNetworkRequest *request;
 	SoupMessage *message;
-	char *uri;
+	char *uri, *data;
 
 	switch (webkit_web_view_get_load_status(b->UI.view)) {
+	case WEBKIT_LOAD_PROVISIONAL:
+		b->State.load_start = g_get_monotonic_time();
+
+		/* check if the connection was warmed up */
+		frame = webkit_web_view_get_main_frame(b->UI.view);
+		if ((source = webkit_web_frame_get_provisional_data_source(frame))) {
+			request = webkit_web_data_source_get_request(source);
+			preconnect_navigated(webkit_network_request_get_uri(request));
+			prefetch_navigated(webkit_network_request_get_uri(request));
+		}
+		break;
 	case WEBKIT_LOAD_COMMITTED:
+		/* while offline, everything comes from the cache */
+		b->State.stale = ripcurl->Global.offline;
+		ripcurl->Autosave.session = TRUE;
+
+		/* time to first paint */
+		if (ripcurl->Profile.enabled && !ripcurl->Profile.painted) {
+			g_signal_connect(G_OBJECT(b->UI.view), "expose-event", G_CALLBACK(cb_wv_first_paint), b);
+		}
+
 		uri = browser_get_uri(b);
 		if (strstr(uri, "https://") == uri) {
 			/* get ssl state */
@@ -642,11 +1291,32 @@ void cb_wv_notify_load_status(WebKitWebView *view, GParamSpec *pspec, Browser *b
 		}
 		break;
 	case WEBKIT_LOAD_FINISHED:
+		/* back from suspension */
+		if (b->Suspend.restore_scroll) {
+			gtk_adjustment_set_value(gtk_scrolled_window_get_hadjustment(b->UI.scrolled_window), b->Suspend.scroll_x);
+			gtk_adjustment_set_value(gtk_scrolled_window_get_vadjustment(b->UI.scrolled_window), b->Suspend.scroll_y);
+			b->Suspend.restore_scroll = FALSE;
+		}
+
 		/* add uri to history */
 		if (!private_browsing && (uri = (char *)webkit_web_view_get_uri(b->UI.view))) {
-			history_add(uri);
+			history_add(uri, webkit_web_view_get_title(b->UI.view));
+
+			if (ripcurl->Global.index && g_str_has_prefix(uri, "http")) {
+				history_index_page(b);
+			}
 		}
 		b->State.progress = 100;
+
+		/* "<load time in ms> <uri>" */
+		asprintf(&data, "%" G_GINT64_FORMAT " %s",
+				(g_get_monotonic_time() - b->State.load_start) / 1000, browser_get_uri(b));
+		record_event("load", data);
+		free(data);
+
+		cache_schedule_dump();
+
+		replay_load_finished();
 		break;
 	default:
 		break;
@@ -674,6 +1344,20 @@ void cb_wv_notify_title(WebKitWebView *view, GParamSpec *pspec, Browser *b)
 void cb_wv_scrolled(GtkAdjustment *adjustment, Browser *b)
 {
 	browser_update_position(b);
+	ripcurl->Autosave.session = TRUE;
+}
+
+gboolean cb_wv_first_paint(GtkWidget *widget, GdkEventExpose *event, Browser *b)
+{
+	g_signal_handlers_disconnect_by_func(G_OBJECT(widget), G_CALLBACK(cb_wv_first_paint), b);
+
+	if (!ripcurl->Profile.painted) {
+		profile_end(&ripcurl->Profile.first_paint);
+		ripcurl->Profile.painted = TRUE;
+		profile_check();
+	}
+
+	return FALSE;
 }
 
 WebKitWebView *cb_inspector_new(WebKitWebInspector *inspector, WebKitWebView *view, Browser *b)
@@ -725,6 +1409,14 @@ gboolean cb_inputbar_keypress(GtkWidget *widget, GdkEventKey *event, Browser *b)
 	int i;
 	gboolean processed = FALSE;
 
+	/* remember when the key was pressed, in case it activates the inputbar */
+	b->State.key_time = stats_event_time(event);
+
+	/* activation is recorded as a command instead */
+	if (event->keyval != GDK_Return && event->keyval != GDK_KP_Enter) {
+		record_key("ikey", event);
+	}
+
 	gdk_keymap_translate_keyboard_state(
 			ripcurl->Global.keymap, event->hardware_keycode, event->state, event->group, /* in */
 			&keyval, NULL, NULL, &consumed_modifiers);	/* out */
@@ -764,14 +1456,21 @@ void cb_inputbar_changed(GtkEntry *entry, Browser *b)
 
 void cb_inputbar_activate(GtkEntry *entry, Browser *b)
 {
-	char *input, **tokens, *command;
+	char *input, **tokens, *command, *action;
 	char identifier;
 	int i, n;
 	gboolean ret = FALSE;
 	gboolean processed = FALSE;
 	GList *list;
+	gint64 start;
+
+	/* activation without a key press (e.g. from a program) starts now */
+	start = b->State.key_time ? b->State.key_time : g_get_monotonic_time();
+	b->State.key_time = 0;
+	b->State.load_start = g_get_monotonic_time();
 
 	input = strdup(gtk_entry_get_text(entry));
+	record_event("cmd", input);
 
 	if (strlen(input) <= 1) {
 		/* no input */
@@ -794,6 +1493,10 @@ void cb_inputbar_activate(GtkEntry *entry, Browser *b)
 				isc_abort(b, NULL);
 			}
 			free(input);
+
+			asprintf(&action, "%c", identifier);
+			stats_record_latency(action, start);
+			free(action);
 			return;
 		}
 	}
@@ -836,65 +1539,228 @@ void cb_inputbar_activate(GtkEntry *entry, Browser *b)
 		}
 	}
 
+	if (processed) {
+		action = strconcat(":", commands[i].name, NULL);
+		stats_record_latency(action, start);
+		free(action);
+	}
+
 	strfreev(tokens);
 }
 
-Browser *browser_new(void)
+/*
+ * while offline, accept cached responses regardless of their age
+ */
+void cb_soup_request_queued(SoupSession *session, SoupMessage *message, gpointer data)
 {
-	GtkAdjustment *adjustment;
+	/* the first page is requested, too late to connect ahead of it */
+	if (ripcurl->Preconnect.startup) {
+		free(ripcurl->Preconnect.startup);
+		ripcurl->Preconnect.startup = NULL;
+	}
 
-	Browser *b = emalloc(sizeof *b);
+	/* https needs the ca database, the cookies are applied on navigation */
+	if (!ripcurl->Load.tls_applied && soup_message_get_uri(message)->scheme == SOUP_URI_SCHEME_HTTPS) {
+		tls_apply();
+	}
 
-	b->UI.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
-	b->UI.box = GTK_BOX(gtk_vbox_new(FALSE, 0));
-	b->UI.pane = GTK_PANED(gtk_vpaned_new());
-	b->UI.scrolled_window = GTK_SCROLLED_WINDOW(gtk_scrolled_window_new(NULL, NULL));
-	b->UI.view = WEBKIT_WEB_VIEW(webkit_web_view_new());
-	b->UI.statusbar = gtk_event_box_new();
-	b->UI.statusbar_entries = GTK_BOX(gtk_hbox_new(FALSE, 0));
-	b->UI.inputbar = GTK_ENTRY(gtk_entry_new());
+	if (ripcurl->Global.offline) {
+		soup_message_headers_replace(message->request_headers, "Cache-Control", "max-stale");
+	}
+}
 
-	/* window */
-	gtk_window_set_title(GTK_WINDOW(b->UI.window), "ripcurl");
-	g_signal_connect(G_OBJECT(b->UI.window), "destroy", G_CALLBACK(cb_win_destroy), b);
+/*
+ * mark messages that went to the network - all others were answered from
+ * the cache
+ */
+void cb_soup_request_started(SoupSession *session, SoupMessage *message, SoupSocket *socket, gpointer data)
+{
+	g_object_set_data(G_OBJECT(message), "ripcurl-network", GINT_TO_POINTER(TRUE));
+}
 
-	/* pane */
-	gtk_paned_pack1(b->UI.pane, GTK_WIDGET(b->UI.scrolled_window), TRUE, TRUE);
+void cb_soup_request_unqueued(SoupSession *session, SoupMessage *message, gpointer data)
+{
+	if (message->method != SOUP_METHOD_GET) {
+		/* not cacheable */
+		return;
+	}
 
-	/* box */
-	gtk_container_add(GTK_CONTAINER(b->UI.window), GTK_WIDGET(b->UI.box));
+	if (message->status_code == SOUP_STATUS_NOT_MODIFIED) {
+		ripcurl->Stats.cache_revalidated++;
+	} else if (!SOUP_STATUS_IS_SUCCESSFUL(message->status_code)) {
+		/* cancelled or failed */
+		return;
+	} else if (g_object_get_data(G_OBJECT(message), "ripcurl-network")) {
+		ripcurl->Stats.cache_misses++;
+	} else {
+		ripcurl->Stats.cache_hits++;
+	}
+}
 
-	/* view */
-	adjustment = gtk_scrolled_window_get_vadjustment(b->UI.scrolled_window);
+/*
+ * only html documents that fit in the remaining budget are prefetched
+ */
+void cb_soup_prefetch_got_headers(SoupMessage *message, gpointer data)
+{
+	const char *type;
+	goffset length;
 
-	g_signal_connect(G_OBJECT(b->UI.view), "console-message", G_CALLBACK(cb_wv_console_message), b);
-	g_signal_connect(G_OBJECT(b->UI.view), "create-web-view", G_CALLBACK(cb_wv_create_web_view), b);
-	g_signal_connect(G_OBJECT(b->UI.view), "hovering-over-link", G_CALLBACK(cb_wv_hover_link), b);
-	g_signal_connect(G_OBJECT(b->UI.view), "mime-type-policy-decision-requested", G_CALLBACK(cb_wv_mime_type_decision), b);
-	g_signal_connect(G_OBJECT(b->UI.view), "download-requested", G_CALLBACK(cb_wv_download_requested), b);
-	g_signal_connect(G_OBJECT(b->UI.view), "notify::load-status", G_CALLBACK(cb_wv_notify_load_status), b);
-	g_signal_connect(G_OBJECT(b->UI.view), "notify::progress", G_CALLBACK(cb_wv_notify_progress), b);
-	g_signal_connect(G_OBJECT(b->UI.view), "notify::title", G_CALLBACK(cb_wv_notify_title), b);
-	g_signal_connect(G_OBJECT(adjustment), "value-changed", G_CALLBACK(cb_wv_scrolled), b);
+	if (!SOUP_STATUS_IS_SUCCESSFUL(message->status_code)) {
+		return;
+	}
 
-	g_signal_connect(G_OBJECT(b->UI.scrolled_window), "key-press-event", G_CALLBACK(cb_wv_keypress), b);
+	type = soup_message_headers_get_content_type(message->response_headers, NULL);
+	length = soup_message_headers_get_content_length(message->response_headers);
 
-	gtk_container_add(GTK_CONTAINER(b->UI.scrolled_window), GTK_WIDGET(b->UI.view));
+	if ((type && strcmp(type, "text/html") && strcmp(type, "application/xhtml+xml")) ||
+			length > prefetch_budget_left()) {
+		prefetch_limit(message);
+	}
+}
 
-	/* inspector */
-	if (developer_extras) {
-		b->UI.inspector = WEBKIT_WEB_INSPECTOR(webkit_web_view_get_inspector(b->UI.view));
-		g_signal_connect(G_OBJECT(b->UI.inspector), "inspect-web-view", G_CALLBACK(cb_inspector_new), b);
-		g_signal_connect(G_OBJECT(b->UI.inspector), "show-window", G_CALLBACK(cb_inspector_show), b);
-		g_signal_connect(G_OBJECT(b->UI.inspector), "close-window", G_CALLBACK(cb_inspector_close), b);
-		g_signal_connect(G_OBJECT(b->UI.inspector), "finished", G_CALLBACK(cb_inspector_finished), b);
+/*
+ * count the body as it arrives and stop once the budget is used up
+ */
+void cb_soup_prefetch_got_chunk(SoupMessage *message, SoupBuffer *chunk, gpointer data)
+{
+	goffset left = prefetch_budget_left();
+
+	ripcurl->Prefetch.bytes += chunk->length;
 
-		b->State.inspecting = FALSE;
+	if ((goffset)chunk->length >= left) {
+		prefetch_limit(message);
 	}
+}
 
-	/* statusbar */
-	b->Statusbar.text = GTK_LABEL(gtk_label_new(NULL));
-	b->Statusbar.buffer = GTK_LABEL(gtk_label_new(NULL));
+void cb_soup_prefetch_finished(SoupSession *session, SoupMessage *message, gpointer data)
+{
+	GList *list;
+	Browser *b;
+	gint64 *time;
+
+	/* the browser may be gone - find it by its message */
+	for (list = ripcurl->Global.browsers; list; list = g_list_next(list)) {
+		b = list->data;
+		if (b->Hover.message == message) {
+			b->Hover.message = NULL;
+		}
+	}
+
+	if (g_object_get_data(G_OBJECT(message), "ripcurl-prefetch-limited")) {
+		/* counted by prefetch_limit() */
+		return;
+	}
+
+	if (message->status_code == SOUP_STATUS_CANCELLED) {
+		ripcurl->Stats.prefetch_cancelled++;
+		return;
+	}
+
+	if (SOUP_STATUS_IS_SUCCESSFUL(message->status_code)) {
+		time = emalloc(sizeof *time);
+		*time = g_get_monotonic_time();
+		g_hash_table_replace(ripcurl->Prefetch.uris,
+				soup_uri_to_string(soup_message_get_uri(message), FALSE), time);
+	}
+}
+
+void cb_network_changed(GNetworkMonitor *monitor, gboolean available, gpointer data)
+{
+	if (ripcurl->Global.offline_mode == AUTO) {
+		offline_set(!available);
+	}
+}
+
+/*
+ * open a window, taking the spare one if there is one
+ */
+Browser *browser_new(void)
+{
+	Browser *b;
+	gint64 start = g_get_monotonic_time();
+
+	if ((b = ripcurl->Spare.browser)) {
+		ripcurl->Spare.browser = NULL;
+		ripcurl->Stats.spare_hits++;
+	} else {
+		b = browser_build(TRUE);
+		ripcurl->Stats.spare_misses++;
+	}
+
+	/* time to window, until it is mapped */
+	b->State.window_start = start;
+	g_signal_connect(G_OBJECT(b->UI.window), "map-event", G_CALLBACK(cb_win_map), b);
+
+	browser_show(b);
+
+	/* add to list of browsers */
+	ripcurl->Global.browsers = g_list_prepend(ripcurl->Global.browsers, b);
+	ripcurl->Autosave.session = TRUE;
+
+	b->Suspend.active_time = g_get_monotonic_time();
+
+	gtk_widget_grab_focus(GTK_WIDGET(b->UI.scrolled_window));
+
+	/* keep within the live window budget, b is about to load a page */
+	if (live_windows > 0) {
+		suspend_check(b);
+	}
+
+	spare_schedule();
+
+	return b;
+}
+
+/*
+ * build a window without showing it, without a web view unless view is
+ * set - browser_placeholder() fills windows built without one
+ */
+Browser *browser_build(gboolean view)
+{
+	GtkAdjustment *adjustment;
+
+	Browser *b = emalloc(sizeof *b);
+
+	b->UI.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+	b->UI.box = GTK_BOX(gtk_vbox_new(FALSE, 0));
+	b->UI.pane = GTK_PANED(gtk_vpaned_new());
+	b->UI.scrolled_window = GTK_SCROLLED_WINDOW(gtk_scrolled_window_new(NULL, NULL));
+	b->UI.placeholder = NULL;
+	b->UI.statusbar = gtk_event_box_new();
+	b->UI.statusbar_entries = GTK_BOX(gtk_hbox_new(FALSE, 0));
+	b->UI.inputbar = GTK_ENTRY(gtk_entry_new());
+
+	/* window */
+	gtk_window_set_title(GTK_WINDOW(b->UI.window), "ripcurl");
+	g_signal_connect(G_OBJECT(b->UI.window), "destroy", G_CALLBACK(cb_win_destroy), b);
+	g_signal_connect(G_OBJECT(b->UI.window), "focus-in-event", G_CALLBACK(cb_win_focus), b);
+	g_signal_connect(G_OBJECT(b->UI.window), "focus-out-event", G_CALLBACK(cb_win_focus), b);
+
+	/* pane */
+	gtk_paned_pack1(b->UI.pane, GTK_WIDGET(b->UI.scrolled_window), TRUE, TRUE);
+
+	/* box */
+	gtk_container_add(GTK_CONTAINER(b->UI.window), GTK_WIDGET(b->UI.box));
+
+	/* scrolled window */
+	adjustment = gtk_scrolled_window_get_vadjustment(b->UI.scrolled_window);
+
+	g_signal_connect(G_OBJECT(adjustment), "value-changed", G_CALLBACK(cb_wv_scrolled), b);
+	g_signal_connect(G_OBJECT(b->UI.scrolled_window), "key-press-event", G_CALLBACK(cb_wv_keypress), b);
+
+	/* view */
+	b->State.inspecting = FALSE;
+	b->State.lite = FALSE;
+	if (view) {
+		browser_view_new(b);
+	} else {
+		b->UI.view = NULL;
+		b->UI.inspector = NULL;
+	}
+
+	/* statusbar */
+	b->Statusbar.text = GTK_LABEL(gtk_label_new(NULL));
+	b->Statusbar.buffer = GTK_LABEL(gtk_label_new(NULL));
 	b->Statusbar.position = GTK_LABEL(gtk_label_new(NULL));
 
 	gtk_box_pack_start(b->UI.statusbar_entries, GTK_WIDGET(b->Statusbar.text), TRUE, TRUE, 0);
@@ -914,19 +1780,70 @@ Browser *browser_new(void)
 	gtk_box_pack_start(b->UI.box, GTK_WIDGET(b->UI.inputbar), FALSE, FALSE, 0);
 
 	browser_apply_settings(b);
-	browser_show(b);
 
-	/* add to list of browsers */
-	ripcurl->Global.browsers = g_list_prepend(ripcurl->Global.browsers, b);
+	/* link hover */
+	b->Hover.uri = NULL;
+	b->Hover.timer = 0;
+	b->Hover.message = NULL;
 
 	/* mode */
 	b->State.mode = NORMAL;
+	b->State.stale = FALSE;
+	b->State.key_time = 0;
+	b->State.window_start = 0;
 
-	gtk_widget_grab_focus(GTK_WIDGET(b->UI.scrolled_window));
+	/* suspension */
+	b->Suspend.suspended = b->Suspend.restore_scroll = FALSE;
+	b->Suspend.active_time = g_get_monotonic_time();
+	b->Suspend.uri = NULL;
+	b->Suspend.history = NULL;
+	b->Suspend.current = NULL;
 
 	return b;
 }
 
+/*
+ * create the web view of b, in its scrolled window
+ */
+void browser_view_new(Browser *b)
+{
+	WebKitWebFrame *frame;
+
+	b->UI.view = WEBKIT_WEB_VIEW(webkit_web_view_new());
+
+	g_signal_connect(G_OBJECT(b->UI.view), "console-message", G_CALLBACK(cb_wv_console_message), b);
+	g_signal_connect(G_OBJECT(b->UI.view), "create-web-view", G_CALLBACK(cb_wv_create_web_view), b);
+	g_signal_connect(G_OBJECT(b->UI.view), "hovering-over-link", G_CALLBACK(cb_wv_hover_link), b);
+	g_signal_connect(G_OBJECT(b->UI.view), "mime-type-policy-decision-requested", G_CALLBACK(cb_wv_mime_type_decision), b);
+	g_signal_connect(G_OBJECT(b->UI.view), "navigation-policy-decision-requested", G_CALLBACK(cb_wv_navigation_decision), b);
+	g_signal_connect(G_OBJECT(b->UI.view), "download-requested", G_CALLBACK(cb_wv_download_requested), b);
+	g_signal_connect(G_OBJECT(b->UI.view), "resource-request-starting", G_CALLBACK(cb_wv_resource_request_starting), b);
+	g_signal_connect(G_OBJECT(b->UI.view), "notify::load-status", G_CALLBACK(cb_wv_notify_load_status), b);
+	g_signal_connect(G_OBJECT(b->UI.view), "notify::progress", G_CALLBACK(cb_wv_notify_progress), b);
+	g_signal_connect(G_OBJECT(b->UI.view), "notify::title", G_CALLBACK(cb_wv_notify_title), b);
+
+	gtk_container_add(GTK_CONTAINER(b->UI.scrolled_window), GTK_WIDGET(b->UI.view));
+
+	/* inspector */
+	b->UI.inspector = NULL;
+	if (developer_extras) {
+		b->UI.inspector = WEBKIT_WEB_INSPECTOR(webkit_web_view_get_inspector(b->UI.view));
+		g_signal_connect(G_OBJECT(b->UI.inspector), "inspect-web-view", G_CALLBACK(cb_inspector_new), b);
+		g_signal_connect(G_OBJECT(b->UI.inspector), "show-window", G_CALLBACK(cb_inspector_show), b);
+		g_signal_connect(G_OBJECT(b->UI.inspector), "close-window", G_CALLBACK(cb_inspector_close), b);
+		g_signal_connect(G_OBJECT(b->UI.inspector), "finished", G_CALLBACK(cb_inspector_finished), b);
+	}
+
+	/* scrollbars */
+	if (!show_scrollbars) {
+		frame = webkit_web_view_get_main_frame(b->UI.view);
+		g_signal_connect(G_OBJECT(frame), "scrollbars-policy-changed", G_CALLBACK(gtk_true), NULL);
+	}
+
+	/* apply browser settings */
+	browser_set_settings(b, NULL);
+}
+
 void browser_show(Browser * b)
 {
 	gtk_widget_show_all(b->UI.window);
@@ -939,21 +1856,13 @@ void browser_show(Browser * b)
 
 void browser_apply_settings(Browser *b)
 {
-	WebKitWebFrame *frame;
-
 	/* view */
 	if (show_scrollbars) {
 		gtk_scrolled_window_set_policy(b->UI.scrolled_window, GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
 	} else {
-		frame = webkit_web_view_get_main_frame(b->UI.view);
-		g_signal_connect(G_OBJECT(frame), "scrollbars-policy-changed", G_CALLBACK(gtk_true), NULL);
-
 		gtk_scrolled_window_set_policy(b->UI.scrolled_window, GTK_POLICY_NEVER, GTK_POLICY_NEVER);
 	}
 
-	/* apply browser settings */
-	webkit_web_view_set_settings(b->UI.view, ripcurl->Global.webkit_settings);
-
 	/* statusbar */
 	gtk_misc_set_alignment(GTK_MISC(b->Statusbar.text), 0.0, 0.0);
 	gtk_misc_set_alignment(GTK_MISC(b->Statusbar.buffer), 1.0, 0.0);
@@ -983,10 +1892,33 @@ void browser_apply_settings(Browser *b)
 
 }
 
+/*
+ * give the view the settings of the site at uri, with images, scripts and
+ * plugins turned off in lite mode
+ */
+void browser_set_settings(Browser *b, const char *uri)
+{
+	WebKitWebSettings *settings;
+
+	settings = sites_settings(sites_lookup(uri));
+
+	if (b->State.lite) {
+		settings = sites_lite_settings(settings);
+	}
+
+	if (webkit_web_view_get_settings(b->UI.view) != settings) {
+		webkit_web_view_set_settings(b->UI.view, settings);
+	}
+}
+
 char *browser_get_uri(Browser *b)
 {
 	char *uri;
 
+	if (b->Suspend.suspended) {
+		return b->Suspend.uri;
+	}
+
 	if (!(uri = (char *)webkit_web_view_get_uri(b->UI.view))) {
 		uri = "about:blank";
 	}
@@ -1156,11 +2088,20 @@ void browser_update_uri(Browser *b)
 	/* check for navigation */
 	nav = strdup("");
 
-	if (webkit_web_view_can_go_back(b->UI.view)) {
-		strappend(nav, "-");
-	}
-	if (webkit_web_view_can_go_forward(b->UI.view)) {
-		strappend(nav, "+");
+	if (b->Suspend.suspended) {
+		if (b->Suspend.history && b->Suspend.history->data != b->Suspend.current) {
+			strappend(nav, "-");
+		}
+		if (b->Suspend.history && g_list_last(b->Suspend.history)->data != b->Suspend.current) {
+			strappend(nav, "+");
+		}
+	} else {
+		if (webkit_web_view_can_go_back(b->UI.view)) {
+			strappend(nav, "-");
+		}
+		if (webkit_web_view_can_go_forward(b->UI.view)) {
+			strappend(nav, "+");
+		}
 	}
 
 	if (strlen(nav) > 0) {
@@ -1172,6 +2113,27 @@ void browser_update_uri(Browser *b)
 
 	free(nav);
 
+	/* offline */
+	if (b->State.stale || ripcurl->Global.offline) {
+		temp = strconcat(text, b->State.stale ? " [stale]" : " [offline]", NULL);
+		free(text);
+		text = temp;
+	}
+
+	/* lite mode */
+	if (b->State.lite) {
+		temp = strconcat(text, " [lite]", NULL);
+		free(text);
+		text = temp;
+	}
+
+	/* suspended */
+	if (b->Suspend.suspended) {
+		temp = strconcat(text, " [suspended]", NULL);
+		free(text);
+		text = temp;
+	}
+
 	/* apply statusbar colors */
 	gtk_widget_modify_bg(GTK_WIDGET(b->UI.statusbar), GTK_STATE_NORMAL, bg);
 	gtk_widget_modify_fg(GTK_WIDGET(b->UI.statusbar), GTK_STATE_NORMAL, fg);
@@ -1225,149 +2187,2202 @@ void browser_update(Browser *b)
 	browser_update_position(b);
 }
 
-void browser_destroy(Browser * b)
+/*
+ * pointer rested on a link - warm up the connection to its host
+ */
+gboolean browser_hover_timeout(gpointer data)
 {
-	webkit_web_view_stop_loading(b->UI.view);
-	/* block signal handler for b->UI.window:"destroy" - prevents infinite loop */
-	g_signal_handlers_block_by_func(G_OBJECT(b->UI.window), G_CALLBACK(cb_win_destroy), b);
-	/* destroy elements */
-	gtk_widget_destroy(b->UI.window);
+	Browser *b = data;
 
-	/* remove from list of browsers */
-	ripcurl->Global.browsers = g_list_remove(ripcurl->Global.browsers, b);
-	/* free data */
-	free(b);
+	b->Hover.timer = 0;
 
-	/* quit if no windows left */
-	if (g_list_length(ripcurl->Global.browsers) == 0) {
-		gtk_main_quit();
+	/* a prefetch opens the connection as well */
+	if (!(hover_prefetch && prefetch_start(b)) && hover_preconnect) {
+		preconnect(b->Hover.uri, TRUE);
 	}
+
+	return FALSE;
 }
 
-void bookmarks_write(void)
+/*
+ * copy the back/forward list of b, oldest item first
+ *
+ * Return: list of history items to be unreferenced by the caller
+ */
+GList *browser_get_history(Browser *b, WebKitWebHistoryItem **current)
 {
-	GList *list;
-	FILE *fp;
+	WebKitWebBackForwardList *bfl;
+	WebKitWebHistoryItem *item;
+	GList *back, *forward, *list, *history = NULL;
 
-	if (!(fp = fopen(ripcurl->Files.bookmarks_file, "w"))) {
-		print_err("unable to open bookmarks file for writing\n");
-		return;
-	}
+	*current = NULL;
 
-	for (list = ripcurl->Global.bookmarks; list; list = g_list_next(list)) {
-		fprintf(fp, "%s\n", (char *)list->data);
-	}
+	/* webkit returns the back list nearest first and the forward list farthest first */
+	bfl = webkit_web_view_get_back_forward_list(b->UI.view);
+	back = webkit_web_back_forward_list_get_back_list_with_limit(bfl,
+			webkit_web_back_forward_list_get_back_length(bfl));
+	forward = webkit_web_back_forward_list_get_forward_list_with_limit(bfl,
+			webkit_web_back_forward_list_get_forward_length(bfl));
 
-	if (fclose(fp)) {
-		print_err("unable to close bookmarks file\n");
+	for (list = forward; list; list = g_list_next(list)) {
+		history = g_list_prepend(history, webkit_web_history_item_copy(list->data));
+	}
+	if ((item = webkit_web_back_forward_list_get_current_item(bfl))) {
+		*current = webkit_web_history_item_copy(item);
+		history = g_list_prepend(history, *current);
 	}
+	for (list = back; list; list = g_list_next(list)) {
+		history = g_list_prepend(history, webkit_web_history_item_copy(list->data));
+	}
+
+	g_list_free(back);
+	g_list_free(forward);
+
+	return history;
 }
 
-void history_add(char *uri)
+/*
+ * keep the uri, scroll position and back/forward list of b and replace its
+ * view with a placeholder
+ */
+void browser_suspend(Browser *b)
 {
-	GList *link;
-
-	if (!uri) {
+	if (b->Suspend.suspended) {
 		return;
 	}
 
-	/* check if uri is already in history */
-	link = g_list_find_custom(ripcurl->Global.history, uri, (GCompareFunc)strcmp_s);
-	if (link) {
-		/* uri is already present - move to front of list */
-		ripcurl->Global.history = g_list_remove_link(ripcurl->Global.history, link);
-		ripcurl->Global.history = g_list_concat(link, ripcurl->Global.history);
-	} else {
-		/* uri not present - prepend to list */
-		ripcurl->Global.history = g_list_prepend(ripcurl->Global.history, strdup(uri));
+	b->Suspend.uri = strdup(browser_get_uri(b));
+	b->Suspend.scroll_x = gtk_adjustment_get_value(gtk_scrolled_window_get_hadjustment(b->UI.scrolled_window));
+	b->Suspend.scroll_y = gtk_adjustment_get_value(gtk_scrolled_window_get_vadjustment(b->UI.scrolled_window));
+	b->Suspend.history = browser_get_history(b, &b->Suspend.current);
+
+	browser_unload(b);
+}
+
+/*
+ * replace the view of b with a placeholder showing b->Suspend.uri
+ */
+void browser_unload(Browser *b)
+{
+	/* stop link hover work */
+	if (b->Hover.timer) {
+		g_source_remove(b->Hover.timer);
+		b->Hover.timer = 0;
 	}
+	prefetch_cancel(b);
+
+	/* drop the view */
+	webkit_web_view_stop_loading(b->UI.view);
+	gtk_widget_destroy(GTK_WIDGET(b->UI.view));
+	b->UI.view = NULL;
+	b->UI.inspector = NULL;
+
+	browser_placeholder(b);
 }
 
-void history_write(void)
+/*
+ * show b->Suspend.uri in place of the view of b
+ */
+void browser_placeholder(Browser *b)
+{
+	GtkWidget *label;
+	char *text;
+
+	asprintf(&text, "Suspended: %s", b->Suspend.uri);
+	label = gtk_label_new(text);
+	free(text);
+	gtk_scrolled_window_add_with_viewport(b->UI.scrolled_window, label);
+	b->UI.placeholder = gtk_bin_get_child(GTK_BIN(b->UI.scrolled_window));
+	gtk_widget_show_all(b->UI.placeholder);
+
+	b->Suspend.suspended = TRUE;
+	b->State.progress = 0;
+	browser_update_uri(b);
+}
+
+/*
+ * recreate the view of a suspended window and load its page again
+ */
+void browser_resume(Browser *b)
 {
+	WebKitWebBackForwardList *bfl;
 	GList *list;
-	FILE *fp;
-	int i;
 
-	if (!(fp = fopen(ripcurl->Files.history_file, "w"))) {
-		print_err("unable to open history file for writing\n");
+	if (!b->Suspend.suspended) {
 		return;
 	}
 
-	for (list = g_list_last(ripcurl->Global.history), i = 0; list; list = g_list_previous(list), i++) {
-		if (history_limit && i >= history_limit) {
-			/* history limit reached - stop */
-			break;
-		}
-		fprintf(fp, "%s\n", (char *)list->data);
+	gtk_widget_destroy(b->UI.placeholder);
+	b->UI.placeholder = NULL;
+
+	browser_view_new(b);
+	b->Suspend.suspended = FALSE;
+	browser_set_settings(b, b->Suspend.uri);
+	gtk_widget_show(GTK_WIDGET(b->UI.view));
+
+	/* rebuild the back/forward list, the last added item is the current one */
+	bfl = webkit_web_view_get_back_forward_list(b->UI.view);
+	for (list = b->Suspend.history; list; list = g_list_next(list)) {
+		webkit_web_back_forward_list_add_item(bfl, list->data);
 	}
 
-	if (fclose(fp)) {
-		print_err("unable to close history file\n");
+	b->Suspend.restore_scroll = TRUE;
+	if (b->Suspend.current) {
+		webkit_web_view_go_to_back_forward_item(b->UI.view, b->Suspend.current);
+	} else {
+		webkit_web_view_load_uri(b->UI.view, b->Suspend.uri);
 	}
-}
 
-void ripcurl_init(void)
-{
-	/* webkit settings */
-	ripcurl->Global.webkit_settings = webkit_web_settings_new();
+	g_list_free_full(b->Suspend.history, g_object_unref);
+	b->Suspend.history = NULL;
+	b->Suspend.current = NULL;
+	free(b->Suspend.uri);
+	b->Suspend.uri = NULL;
 
-	/* libsoup session */
-	ripcurl->Global.soup_session = webkit_get_default_session();
+	ripcurl->Stats.resumed++;
 
-	/* browser list */
-	ripcurl->Global.browsers = NULL;
+	gtk_widget_grab_focus(GTK_WIDGET(b->UI.scrolled_window));
+	browser_update(b);
+}
 
-	/* bookmarks list */
-	ripcurl->Global.bookmarks = NULL;
+void browser_destroy(Browser * b)
+{
+	/* closing the last window ends the session */
+	if (ripcurl->Global.browsers && !ripcurl->Global.browsers->next) {
+		session_write();
+		ripcurl->Session.closed = TRUE;
+	}
 
-	/* history list */
-	ripcurl->Global.history = NULL;
+	if (b->Hover.timer) {
+		g_source_remove(b->Hover.timer);
+	}
+	free(b->Hover.uri);
+	prefetch_cancel(b);
 
-	/* command history list */
-	ripcurl->Global.command_history = NULL;
+	/* suspended windows have no view */
+	if (b->Suspend.suspended) {
+		g_list_free_full(b->Suspend.history, g_object_unref);
+		free(b->Suspend.uri);
+	} else {
+		webkit_web_view_stop_loading(b->UI.view);
+	}
+	/* block signal handler for b->UI.window:"destroy" - prevents infinite loop */
+	g_signal_handlers_block_by_func(G_OBJECT(b->UI.window), G_CALLBACK(cb_win_destroy), b);
+	/* destroy elements */
+	gtk_widget_destroy(b->UI.window);
 
-	/* GDK keymap */
-	ripcurl->Global.keymap = gdk_keymap_get_default();
+	/* remove from list of browsers */
+	ripcurl->Global.browsers = g_list_remove(ripcurl->Global.browsers, b);
+	ripcurl->Autosave.session = TRUE;
+	/* free data */
+	free(b);
 
-	/* create config dir */
-	ripcurl->Files.config_dir = g_build_filename(g_get_user_config_dir(), "ripcurl", NULL);
-	g_mkdir_with_parents(ripcurl->Files.config_dir, 0771);
+	/* quit if no windows left */
+	if (g_list_length(ripcurl->Global.browsers) == 0) {
+		gtk_main_quit();
+	}
 }
 
-void load_data(void)
+/*
+ * read blocklist_files into a new blocklist
+ */
+void blocklist_load_files(GTask *task, gpointer source, gpointer data, GCancellable *cancellable)
 {
-	SoupCookieJar *cookie_jar;
-	GTlsDatabase *tlsdb;
-	GError *error = NULL;
+	ProfilePhase phase;
+	Blocklist *blocklist;
+	char *path;
+	int i;
 
-	/* load cookies */
-	if (!private_browsing) {
-		ripcurl->Files.cookie_file = g_build_filename(ripcurl->Files.config_dir, cookie_file, NULL);
-		if (!ripcurl->Files.cookie_file) {
-			print_err("error building cookie file path\n");
-		} else {
-			cookie_jar = soup_cookie_jar_text_new(ripcurl->Files.cookie_file, FALSE);
-			soup_session_add_feature(ripcurl->Global.soup_session, SOUP_SESSION_FEATURE(cookie_jar));
+	profile_begin(&phase, "blocklists");
+	blocklist = blocklist_new();
+
+	for (i = 0; blocklist_files[i]; i++) {
+		path = g_build_filename(ripcurl->Files.config_dir, blocklist_files[i], NULL);
+		if (!path) {
+			print_err("error building blocklist file path\n");
+			continue;
 		}
+		blocklist_load(blocklist, path);
+		g_free(path);
 	}
 
-	/* ssl */
-	tlsdb = g_tls_file_database_new(ca_file, &error);
-	if (error) {
-		print_err("error loading ssl database %s: %s\n", ca_file, error->message);
-		g_error_free(error);
+	if (!blocklist_size(blocklist)) {
+		blocklist_free(blocklist);
+		blocklist = NULL;
 	}
-	g_object_set(G_OBJECT(ripcurl->Global.soup_session), "tls-database", tlsdb, NULL);
-	g_object_set(G_OBJECT(ripcurl->Global.soup_session), "ssl-strict", strict_ssl, NULL);
+	profile_end(&phase);
 
-	/* load bookmarks */
-	ripcurl->Files.bookmarks_file = g_build_filename(ripcurl->Files.config_dir, bookmarks_file, NULL);
-	if (!ripcurl->Files.bookmarks_file) {
+	g_task_return_pointer(task, blocklist, NULL);
+}
+
+/*
+ * suspend windows unfocused for suspend_ttl seconds, then the least
+ * recently focused ones while more than live_windows have a page
+ *
+ * data is a window that must not be suspended, or NULL
+ */
+gboolean suspend_check(gpointer data)
+{
+	GList *list;
+	Browser *b;
+	gint64 now;
+	int live = 0;
+
+	now = g_get_monotonic_time();
+
+	for (list = ripcurl->Global.browsers; list; list = g_list_next(list)) {
+		b = list->data;
+		if (b->Suspend.suspended) {
+			continue;
+		}
+
+		if (suspend_ttl > 0 && !b->State.inspecting
+				&& !gtk_window_is_active(GTK_WINDOW(b->UI.window))
+				&& now - b->Suspend.active_time > suspend_ttl * G_USEC_PER_SEC) {
+			browser_suspend(b);
+			ripcurl->Stats.suspended_idle++;
+		} else {
+			live++;
+		}
+	}
+
+	while (live_windows > 0 && live > live_windows && (b = suspend_lru(data))) {
+		browser_suspend(b);
+		ripcurl->Stats.suspended_budget++;
+		live--;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Return: the least recently focused window other than keep that can be
+ * suspended, NULL if there is none
+ */
+Browser *suspend_lru(Browser *keep)
+{
+	GList *list;
+	Browser *b, *lru = NULL;
+
+	for (list = ripcurl->Global.browsers; list; list = g_list_next(list)) {
+		b = list->data;
+		if (b == keep || b->Suspend.suspended || b->State.inspecting
+				|| gtk_window_is_active(GTK_WINDOW(b->UI.window))) {
+			continue;
+		}
+		if (!lru || b->Suspend.active_time < lru->Suspend.active_time) {
+			lru = b;
+		}
+	}
+
+	return lru;
+}
+
+/*
+ * build a new spare window once the main loop is idle
+ */
+void spare_schedule(void)
+{
+	if (spare_window && !ripcurl->Spare.browser && !ripcurl->Spare.idle) {
+		ripcurl->Spare.idle = g_idle_add_full(G_PRIORITY_LOW, spare_fill, NULL, NULL);
+	}
+}
+
+gboolean spare_fill(gpointer data)
+{
+	ripcurl->Spare.idle = 0;
+
+	/* not while short of memory */
+	if (ripcurl->Spare.browser || ripcurl->Memory.level > 0) {
+		return FALSE;
+	}
+
+	ripcurl->Spare.browser = browser_build(TRUE);
+	gtk_widget_realize(ripcurl->Spare.browser->UI.window);
+
+	return FALSE;
+}
+
+/*
+ * destroy the spare window
+ */
+void spare_drop(void)
+{
+	Browser *b = ripcurl->Spare.browser;
+
+	if (ripcurl->Spare.idle) {
+		g_source_remove(ripcurl->Spare.idle);
+		ripcurl->Spare.idle = 0;
+	}
+
+	if (!b) {
+		return;
+	}
+	ripcurl->Spare.browser = NULL;
+
+	g_signal_handlers_block_by_func(G_OBJECT(b->UI.window), G_CALLBACK(cb_win_destroy), b);
+	gtk_widget_destroy(b->UI.window);
+	free(b);
+}
+
+/*
+ * compare the resident set size with memory_soft_limit and
+ * memory_hard_limit - caches are trimmed over the soft limit and windows
+ * suspended over the hard limit
+ */
+gboolean memory_check(gpointer data)
+{
+	goffset rss, soft, hard;
+	Browser *b;
+	int level;
+
+	if ((rss = resident_size()) < 0) {
+		return TRUE;
+	}
+	if (rss > ripcurl->Memory.peak) {
+		ripcurl->Memory.peak = rss;
+	}
+
+	soft = (goffset)memory_soft_limit * 1024 * 1024;
+	hard = (goffset)memory_hard_limit * 1024 * 1024;
+
+	if (hard > 0 && rss > hard) {
+		level = 2;
+	} else if (soft > 0 && rss > soft) {
+		level = 1;
+	} else if (soft <= 0 || rss < soft / 4 * 3) {
+		level = 0;
+	} else {
+		/* keep trimmed until well below the soft limit */
+		level = MIN(ripcurl->Memory.level, 1);
+	}
+
+	if (level > 0 && ripcurl->Memory.level == 0) {
+		memory_trim(rss);
+	} else if (level == 0 && ripcurl->Memory.level > 0) {
+		memory_restore();
+	}
+	ripcurl->Memory.level = level;
+
+	if (level < 2) {
+		return TRUE;
+	}
+
+	/*
+	 * suspend the least recently focused window - the resident size only
+	 * drops once webkit's caches and the allocator let go of the memory, so
+	 * the next window is left for the next check
+	 */
+	if ((b = suspend_lru(NULL))) {
+		browser_suspend(b);
+		ripcurl->Stats.suspended_memory++;
+		print_err("memory: suspended a window at %.1f MiB resident, over the %d MiB hard limit\n",
+				rss / 1048576.0, memory_hard_limit);
+	}
+
+	return TRUE;
+}
+
+/*
+ * shrink webkit's caches, drop the preconnect and prefetch tables and the
+ * removed pages of the full-text index
+ */
+void memory_trim(goffset rss)
+{
+	unsigned int origins, prefetches;
+	goffset after;
+
+	/* remember the settings to restore */
+	ripcurl->Memory.cache_model = webkit_get_cache_model();
+	g_object_get(G_OBJECT(ripcurl->Global.webkit_settings), "enable-page-cache", &ripcurl->Memory.page_cache, NULL);
+
+	/* the smallest memory cache, and no pages kept for back/forward */
+	webkit_set_cache_model(WEBKIT_CACHE_MODEL_DOCUMENT_VIEWER);
+	memory_set_page_cache(FALSE);
+
+	origins = g_hash_table_size(ripcurl->Preconnect.origins);
+	g_hash_table_remove_all(ripcurl->Preconnect.origins);
+	prefetches = g_hash_table_size(ripcurl->Prefetch.uris);
+	g_hash_table_remove_all(ripcurl->Prefetch.uris);
+
+	/* refilled once memory_restore() ran and a window is opened */
+	spare_drop();
+
+	if (ripcurl->Global.index) {
+		index_trim(ripcurl->Global.index);
+	}
+
+	ripcurl->Memory.trims++;
+
+	after = resident_size();
+	print_err("memory: %.1f MiB resident, over the %d MiB soft limit\n",
+			rss / 1048576.0, memory_soft_limit);
+	print_err("memory: document viewer cache model, page cache off, dropped %u preconnected origins "
+			"and %u prefetched uris, %.1f MiB freed\n",
+			origins, prefetches, after >= 0 ? (rss - after) / 1048576.0 : 0.0);
+}
+
+/*
+ * undo memory_trim() once memory usage is back to normal
+ */
+void memory_restore(void)
+{
+	webkit_set_cache_model(ripcurl->Memory.cache_model);
+	memory_set_page_cache(ripcurl->Memory.page_cache);
+
+	print_err("memory: back below the %d MiB soft limit, caches restored\n", memory_soft_limit);
+}
+
+/*
+ * set "enable-page-cache" on the global settings and every copy of them
+ */
+void memory_set_page_cache(gboolean enable)
+{
+	GHashTableIter iter;
+	gpointer settings;
+
+	g_object_set(G_OBJECT(ripcurl->Global.webkit_settings), "enable-page-cache", enable, NULL);
+
+	g_hash_table_iter_init(&iter, ripcurl->Sites.settings);
+	while (g_hash_table_iter_next(&iter, NULL, &settings)) {
+		g_object_set(G_OBJECT(settings), "enable-page-cache", enable, NULL);
+	}
+
+	g_hash_table_iter_init(&iter, ripcurl->Sites.lite);
+	while (g_hash_table_iter_next(&iter, NULL, &settings)) {
+		g_object_set(G_OBJECT(settings), "enable-page-cache", enable, NULL);
+	}
+}
+
+void cb_tls_loaded(GObject *source, GAsyncResult *result, gpointer data)
+{
+	load_done();
+
+	tls_apply();
+	preconnect_startup_connect();
+}
+
+void cb_cookies_loaded(GObject *source, GAsyncResult *result, gpointer data)
+{
+	load_done();
+	cookies_apply();
+	preconnect_startup_connect();
+}
+
+void cb_bookmarks_loaded(GObject *source, GAsyncResult *result, gpointer data)
+{
+	load_done();
+	ripcurl->Global.bookmarks = load_merge(ripcurl->Global.bookmarks,
+			g_task_propagate_pointer(G_TASK(result), NULL));
+}
+
+void cb_history_loaded(GObject *source, GAsyncResult *result, gpointer data)
+{
+	load_done();
+	/* visits since startup are newer than the loaded ones */
+	history_merge(ripcurl->Global.history, g_task_propagate_pointer(G_TASK(result), NULL));
+
+	/* rewrite a flat history file in the record format */
+	if (ripcurl->Load.history_legacy) {
+		history_write();
+	}
+
+	history_index_sync();
+}
+
+void cb_blocklist_loaded(GObject *source, GAsyncResult *result, gpointer data)
+{
+	load_done();
+	ripcurl->Global.blocklist = g_task_propagate_pointer(G_TASK(result), NULL);
+}
+
+/*
+ * run func on a worker thread, callback gets its result on the main thread
+ */
+void load_start(GTaskThreadFunc func, GAsyncReadyCallback callback)
+{
+	GTask *task;
+
+	task = g_task_new(NULL, NULL, callback, NULL);
+	g_task_run_in_thread(task, func);
+	g_object_unref(task);
+
+	ripcurl->Load.pending++;
+}
+
+/*
+ * account for a finished load, called first in its callback
+ */
+void load_done(void)
+{
+	ripcurl->Load.pending--;
+	profile_check();
+}
+
+/*
+ * set a ready flag from a worker and wake up load_wait()
+ */
+void load_ready(gboolean *ready)
+{
+	g_mutex_lock(&ripcurl->Load.lock);
+	*ready = TRUE;
+	g_cond_broadcast(&ripcurl->Load.loaded);
+	g_mutex_unlock(&ripcurl->Load.lock);
+}
+
+void load_wait(gboolean *ready)
+{
+	g_mutex_lock(&ripcurl->Load.lock);
+	while (!*ready) {
+		g_cond_wait(&ripcurl->Load.loaded, &ripcurl->Load.lock);
+	}
+	g_mutex_unlock(&ripcurl->Load.lock);
+}
+
+/*
+ * append the lines of loaded that are not in list yet, compared by their
+ * first word - entries added while loading come first and win
+ *
+ * Return: the merged list
+ */
+GList *load_merge(GList *list, GList *loaded)
+{
+	GHashTable *seen;
+	GList *l, *next;
+	char *key;
+
+	if (!list) {
+		return loaded;
+	}
+
+	seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	for (l = list; l; l = g_list_next(l)) {
+		g_hash_table_add(seen, g_strndup(l->data, strcspn(l->data, " ")));
+	}
+
+	for (l = loaded; l; l = next) {
+		next = g_list_next(l);
+		key = g_strndup(l->data, strcspn(l->data, " "));
+		if (g_hash_table_contains(seen, key)) {
+			free(l->data);
+			loaded = g_list_delete_link(loaded, l);
+		}
+		g_free(key);
+	}
+
+	g_hash_table_destroy(seen);
+
+	return g_list_concat(list, loaded);
+}
+
+/*
+ * build the ca database from ca_file
+ */
+void tls_load(GTask *task, gpointer source, gpointer data, GCancellable *cancellable)
+{
+	ProfilePhase phase;
+	GError *error = NULL;
+
+	profile_begin(&phase, "tls_database");
+	ripcurl->Load.tls_database = g_tls_file_database_new(ca_file, &error);
+	if (error) {
+		print_err("error loading ssl database %s: %s\n", ca_file, error->message);
+		g_error_free(error);
+	}
+	profile_end(&phase);
+
+	load_ready(&ripcurl->Load.tls_ready);
+	g_task_return_boolean(task, TRUE);
+}
+
+/*
+ * give the soup session the ca database, waiting for tls_load() if it is
+ * not done yet
+ */
+void tls_apply(void)
+{
+	if (ripcurl->Load.tls_applied) {
+		return;
+	}
+
+	load_wait(&ripcurl->Load.tls_ready);
+	g_object_set(G_OBJECT(ripcurl->Global.soup_session), "tls-database", ripcurl->Load.tls_database, NULL);
+	ripcurl->Load.tls_applied = TRUE;
+}
+
+/*
+ * open the cookie database, migrating the text cookie file on first use
+ */
+void cookies_load(GTask *task, gpointer source, gpointer data, GCancellable *cancellable)
+{
+	ProfilePhase phase;
+	gboolean migrate;
+
+	profile_begin(&phase, "cookie_jar");
+	migrate = !g_file_test(ripcurl->Files.cookie_file, G_FILE_TEST_EXISTS);
+	ripcurl->Load.cookie_jar = soup_cookie_jar_db_new(ripcurl->Files.cookie_file, FALSE);
+	if (migrate) {
+		cookies_migrate(ripcurl->Load.cookie_jar);
+	}
+	profile_end(&phase);
+
+	load_ready(&ripcurl->Load.cookies_ready);
+	g_task_return_boolean(task, TRUE);
+}
+
+/*
+ * add the cookie jar to the soup session, waiting for cookies_load() if it
+ * is not done yet
+ */
+void cookies_apply(void)
+{
+	if (ripcurl->Load.cookies_applied) {
+		return;
+	}
+
+	load_wait(&ripcurl->Load.cookies_ready);
+	soup_session_add_feature(ripcurl->Global.soup_session, SOUP_SESSION_FEATURE(ripcurl->Load.cookie_jar));
+	g_object_unref(ripcurl->Load.cookie_jar);
+	ripcurl->Load.cookies_applied = TRUE;
+}
+
+/*
+ * copy the cookies of the old text cookie file into jar
+ */
+void cookies_migrate(SoupCookieJar *jar)
+{
+	SoupCookieJar *text_jar;
+	GSList *cookies, *list;
+	char *path;
+	int n = 0;
+
+	path = g_build_filename(ripcurl->Files.config_dir, cookie_text_file, NULL);
+	if (!path || !g_file_test(path, G_FILE_TEST_EXISTS)) {
+		g_free(path);
+		return;
+	}
+
+	text_jar = soup_cookie_jar_text_new(path, TRUE);
+	cookies = soup_cookie_jar_all_cookies(text_jar);
+
+	/* the jar takes ownership of the cookies */
+	for (list = cookies; list; list = g_slist_next(list)) {
+		soup_cookie_jar_add_cookie(jar, list->data);
+		n++;
+	}
+
+	g_slist_free(cookies);
+	g_object_unref(text_jar);
+
+	print_err("migrated %d cookies from %s\n", n, path);
+	g_free(path);
+}
+
+/*
+ * write the open windows to the session file, oldest first:
+ *
+ *   window <active> <scroll x> <scroll y>
+ *   - <uri> <title>		back/forward list, "*" marks the current item
+ *   * <uri> <title>
+ *   + <uri> <title>
+ */
+void session_write(void)
+{
+	WebKitWebHistoryItem *current;
+	GList *list, *history, *item;
+	Browser *b;
+	GString *data;
+	const char *title;
+	double x, y;
+	char mark;
+
+	if (!ripcurl->Files.session_file || ripcurl->Session.closed) {
+		return;
+	}
+
+	data = g_string_new(NULL);
+
+	for (list = g_list_last(ripcurl->Global.browsers); list; list = g_list_previous(list)) {
+		b = list->data;
+
+		if (b->Suspend.suspended) {
+			history = b->Suspend.history;
+			current = b->Suspend.current;
+			x = b->Suspend.scroll_x;
+			y = b->Suspend.scroll_y;
+		} else {
+			history = browser_get_history(b, &current);
+			x = gtk_adjustment_get_value(gtk_scrolled_window_get_hadjustment(b->UI.scrolled_window));
+			y = gtk_adjustment_get_value(gtk_scrolled_window_get_vadjustment(b->UI.scrolled_window));
+		}
+
+		g_string_append_printf(data, "window %d %.0f %.0f\n", gtk_window_is_active(GTK_WINDOW(b->UI.window)), x, y);
+
+		if (!current) {
+			g_string_append_printf(data, "* %s\n", browser_get_uri(b));
+		}
+
+		mark = '-';
+		for (item = history; item; item = g_list_next(item)) {
+			if (item->data == current) {
+				mark = '*';
+			}
+			title = webkit_web_history_item_get_title(item->data);
+			g_string_append_printf(data, "%c %s %s\n", mark, webkit_web_history_item_get_uri(item->data), title ? title : "");
+			if (mark == '*') {
+				mark = '+';
+			}
+		}
+
+		if (!b->Suspend.suspended) {
+			g_list_free_full(history, g_object_unref);
+		}
+	}
+
+	writer_write(ripcurl->Global.writer, ripcurl->Files.session_file, data);
+	ripcurl->Autosave.session = FALSE;
+}
+
+/*
+ * write the session, history and bookmarks if they changed
+ */
+gboolean autosave(gpointer data)
+{
+	if (ripcurl->Autosave.session) {
+		session_write();
+	}
+
+	/* until loaded, the lists only hold what was added since */
+	if (ripcurl->Load.pending > 0) {
+		return TRUE;
+	}
+
+	if (ripcurl->Autosave.bookmarks && ripcurl->Files.bookmarks_file) {
+		bookmarks_write();
+	}
+	if (ripcurl->Autosave.history && ripcurl->Files.history_file) {
+		history_write();
+	}
+
+	return TRUE;
+}
+
+/*
+ * SIGTERM and SIGINT close all windows like :quitall, cleanup() does the rest
+ */
+gboolean cb_signal_quit(gpointer data)
+{
+	if (ripcurl->Global.browsers) {
+		cmd_quitall(NULL, 0, NULL);
+	} else {
+		gtk_main_quit();
+	}
+
+	return FALSE;
+}
+
+/*
+ * reopen the windows of the session file as placeholders, only the active
+ * one is loaded if focus is set - the others never build a web view until
+ * they are focused
+ *
+ * Return: number of windows restored
+ */
+int session_restore(gboolean focus)
+{
+	WebKitWebHistoryItem *item;
+	GList *lines, *list;
+	Browser *b = NULL, *active = NULL;
+	char *line, *uri, *title;
+	int is_active, windows = 0;
+	double x, y;
+
+	if (!ripcurl->Files.session_file) {
+		return 0;
+	}
+
+	lines = g_list_reverse(read_file(ripcurl->Files.session_file, NULL));
+
+	/* a NULL line finishes the last window */
+	lines = g_list_append(lines, NULL);
+
+	for (list = lines; list; list = g_list_next(list)) {
+		line = list->data;
+
+		if (b && (!line || !strncmp(line, "window ", 7))) {
+			/* previous window complete */
+			if (!b->Suspend.uri) {
+				b->Suspend.uri = strdup("about:blank");
+			}
+			b->Suspend.history = g_list_reverse(b->Suspend.history);
+			browser_placeholder(b);
+			/* a window manager focusing new windows would resume them all */
+			gtk_window_set_focus_on_map(GTK_WINDOW(b->UI.window), FALSE);
+			browser_show(b);
+			ripcurl->Global.browsers = g_list_prepend(ripcurl->Global.browsers, b);
+			b = NULL;
+		}
+
+		if (!line) {
+			break;
+		}
+
+		if (sscanf(line, "window %d %lf %lf", &is_active, &x, &y) == 3) {
+			b = browser_build(FALSE);
+			b->Suspend.scroll_x = x;
+			b->Suspend.scroll_y = y;
+			if (is_active || !active) {
+				active = b;
+			}
+			windows++;
+		} else if (b && strchr("-*+", line[0]) && line[1] == ' ') {
+			uri = line + 2;
+			if ((title = strchr(uri, ' '))) {
+				*title++ = '\0';
+			}
+
+			if (line[0] == '*' && !b->Suspend.uri) {
+				b->Suspend.uri = strdup(uri);
+			}
+			if (strcmp(uri, "about:blank")) {
+				item = webkit_web_history_item_new_with_data(uri, title ? title : "");
+				b->Suspend.history = g_list_prepend(b->Suspend.history, item);
+				if (line[0] == '*') {
+					b->Suspend.current = item;
+				}
+			}
+		}
+
+		free(line);
+	}
+	g_list_free(lines);
+
+	if (focus && active) {
+		browser_resume(active);
+		gtk_window_present(GTK_WINDOW(active->UI.window));
+	}
+
+	if (windows) {
+		spare_schedule();
+	}
+
+	return windows;
+}
+
+void bookmarks_load(GTask *task, gpointer source, gpointer data, GCancellable *cancellable)
+{
+	ProfilePhase phase;
+	GList *bookmarks;
+
+	profile_begin(&phase, "bookmarks");
+	bookmarks = g_list_reverse(read_file(ripcurl->Files.bookmarks_file, NULL));
+	profile_end(&phase);
+
+	g_task_return_pointer(task, bookmarks, NULL);
+}
+
+void bookmarks_write(void)
+{
+	GList *list;
+	GString *data = g_string_new(NULL);
+
+	for (list = ripcurl->Global.bookmarks; list; list = g_list_next(list)) {
+		g_string_append_printf(data, "%s\n", (char *)list->data);
+	}
+
+	writer_write(ripcurl->Global.writer, ripcurl->Files.bookmarks_file, data);
+	ripcurl->Autosave.bookmarks = FALSE;
+}
+
+void history_add(char *uri, const char *title)
+{
+	if (!uri) {
+		return;
+	}
+
+	/* moves uri to the front, evicting the oldest entries over history_limit */
+	history_visit(ripcurl->Global.history, uri, title, g_get_real_time() / G_USEC_PER_SEC);
+	ripcurl->Autosave.history = TRUE;
+}
+
+void history_load(GTask *task, gpointer source, gpointer data, GCancellable *cancellable)
+{
+	ProfilePhase phase;
+	History *history;
+
+	profile_begin(&phase, "history");
+	history = history_new(history_limit, (gint64)history_max_age * 86400);
+	history_read_file(history, ripcurl->Files.history_file, &ripcurl->Load.history_legacy);
+	profile_end(&phase);
+
+	g_task_return_pointer(task, history, NULL);
+}
+
+void history_write(void)
+{
+	GString *data;
+
+	history_expire(ripcurl->Global.history, g_get_real_time() / G_USEC_PER_SEC);
+	data = history_serialize(ripcurl->Global.history);
+
+	writer_write(ripcurl->Global.writer, ripcurl->Files.history_file, data);
+	ripcurl->Autosave.history = FALSE;
+}
+
+/*
+ * queue the text of the loaded page for the full-text index
+ */
+void history_index_page(Browser *b)
+{
+	WebKitDOMDocument *doc;
+	WebKitDOMHTMLElement *body;
+	char *text;
+
+	if (!(doc = webkit_web_view_get_dom_document(b->UI.view)) ||
+			!(body = webkit_dom_document_get_body(doc))) {
+		return;
+	}
+
+	if (!(text = webkit_dom_html_element_get_inner_text(body))) {
+		return;
+	}
+
+	/* very long pages are indexed by their beginning, cut at a character */
+	if (strlen(text) > INDEX_MAX_TEXT) {
+		*g_utf8_find_prev_char(text, text + INDEX_MAX_TEXT + 1) = '\0';
+	}
+
+	index_add(ripcurl->Global.index, webkit_web_view_get_uri(b->UI.view),
+			webkit_web_view_get_title(b->UI.view), text);
+	g_free(text);
+}
+
+/*
+ * pages leave the index with their history entry
+ */
+void history_evicted(gpointer entry, gpointer data)
+{
+	if (ripcurl->Global.index) {
+		index_remove(ripcurl->Global.index, ((HistoryEntry *)entry)->uri);
+	}
+}
+
+void history_collect_uri(gpointer entry, gpointer uris)
+{
+	g_hash_table_add(uris, strdup(((HistoryEntry *)entry)->uri));
+}
+
+/*
+ * drop the indexed pages that are no longer in the loaded history, such as
+ * those over a lowered history_limit
+ */
+void history_index_sync(void)
+{
+	GHashTable *uris;
+
+	if (!ripcurl->Global.index) {
+		return;
+	}
+
+	uris = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+	history_foreach(ripcurl->Global.history, history_collect_uri, uris);
+	index_retain(ripcurl->Global.index, uris);
+}
+
+/*
+ * write the cache index once the main loop is idle
+ */
+void cache_schedule_dump(void)
+{
+	if (ripcurl->Global.soup_cache && !ripcurl->Global.cache_dump) {
+		ripcurl->Global.cache_dump = g_idle_add_full(G_PRIORITY_LOW, cache_dump, NULL, NULL);
+	}
+}
+
+gboolean cache_dump(gpointer data)
+{
+	ripcurl->Global.cache_dump = 0;
+
+	soup_cache_flush(ripcurl->Global.soup_cache);
+	soup_cache_dump(ripcurl->Global.soup_cache);
+
+	return FALSE;
+}
+
+void offline_set(gboolean offline)
+{
+	GList *list;
+
+	if (offline == ripcurl->Global.offline) {
+		return;
+	}
+
+	ripcurl->Global.offline = offline;
+
+	for (list = ripcurl->Global.browsers; list; list = g_list_next(list)) {
+		browser_update_uri(list->data);
+	}
+}
+
+/*
+ * get the origin ("scheme://host:port") of an http(s) uri
+ *
+ * Return: dynamically allocated string, NULL if uri is not http(s)
+ */
+char *uri_origin(const char *uri)
+{
+	SoupURI *suri;
+	char *origin = NULL;
+
+	if (!uri || !(suri = soup_uri_new(uri))) {
+		return NULL;
+	}
+
+	if (SOUP_URI_VALID_FOR_HTTP(suri)) {
+		asprintf(&origin, "%s://%s:%u", suri->scheme, suri->host, suri->port);
+	}
+	soup_uri_free(suri);
+
+	return origin;
+}
+
+/*
+ * Return: TRUE if the path of uri names a web font file, the query and
+ * fragment ("font.woff2?v=4.7.0") are not looked at
+ */
+gboolean uri_is_font(const char *uri)
+{
+	static const char *exts[] = { ".woff", ".woff2", ".ttf", ".otf", ".eot", NULL };
+	SoupURI *suri;
+	const char *ext;
+	gboolean font = FALSE;
+	int i;
+
+	if (!(suri = soup_uri_new(uri))) {
+		return FALSE;
+	}
+
+	if (suri->path && (ext = strrchr(suri->path, '.')) && !strchr(ext, '/')) {
+		for (i = 0; exts[i] && !font; i++) {
+			font = !g_ascii_strcasecmp(ext, exts[i]);
+		}
+	}
+	soup_uri_free(suri);
+
+	return font;
+}
+
+SiteNode *site_node_new(void)
+{
+	SiteNode *node = emalloc(sizeof *node);
+
+	node->children = g_hash_table_new_full(g_str_hash, g_str_equal,
+			free, (GDestroyNotify)site_node_free);
+	node->exact = node->subtree = NULL;
+
+	return node;
+}
+
+void site_node_free(SiteNode *node)
+{
+	g_hash_table_destroy(node->children);
+	free(node);
+}
+
+/*
+ * build the host trie from site_rules, "news.example.com" is stored as
+ * com -> example -> news
+ */
+void sites_init(void)
+{
+	SiteNode *node, *child;
+	SiteRule *rule;
+	char **labels, *host;
+	int i, n;
+
+	ripcurl->Sites.root = site_node_new();
+	ripcurl->Sites.settings = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, g_object_unref);
+	ripcurl->Sites.lite = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, g_object_unref);
+
+	for (rule = site_rules; rule < site_rules + LENGTH(site_rules); rule++) {
+		host = rule->host;
+		if (!strncmp(host, "*.", 2)) {
+			host += 2;
+		}
+
+		labels = tokenize(host, ".");
+		for (n = 0; labels[n]; n++);
+
+		node = ripcurl->Sites.root;
+		for (i = n - 1; i >= 0; i--) {
+			if (!(child = g_hash_table_lookup(node->children, labels[i]))) {
+				child = site_node_new();
+				g_hash_table_insert(node->children, g_ascii_strdown(labels[i], -1), child);
+			}
+			node = child;
+		}
+		strfreev(labels);
+
+		if (host != rule->host) {
+			node->subtree = rule;
+		} else {
+			node->exact = rule;
+		}
+	}
+}
+
+/*
+ * find the most specific rule for the host of uri
+ *
+ * Return: the rule, NULL if none matches
+ */
+SiteRule *sites_lookup(const char *uri)
+{
+	SoupURI *suri;
+	SiteNode *node;
+	SiteRule *rule = NULL;
+	const char *host, *end, *dot;
+	char label[64];
+
+	if (!uri || !(suri = soup_uri_new(uri))) {
+		return NULL;
+	}
+
+	if (!(host = suri->host)) {
+		soup_uri_free(suri);
+		return NULL;
+	}
+
+	/* walk the labels from the top level domain down */
+	node = ripcurl->Sites.root;
+	for (end = host + strlen(host); node && end > host; end = (dot > host) ? dot - 1 : host) {
+		for (dot = end; dot > host && dot[-1] != '.'; dot--);
+		if (end - dot >= (int)sizeof label) {
+			node = NULL;
+			break;
+		}
+
+		memcpy(label, dot, end - dot);
+		label[end - dot] = '\0';
+
+		if ((node = g_hash_table_lookup(node->children, label)) && node->subtree) {
+			rule = node->subtree;
+		}
+	}
+
+	if (node && node->exact) {
+		rule = node->exact;
+	}
+
+	soup_uri_free(suri);
+
+	return rule;
+}
+
+/*
+ * Return: the settings for pages matching rule, created on first use and
+ * shared by every window
+ */
+WebKitWebSettings *sites_settings(SiteRule *rule)
+{
+	WebKitWebSettings *settings;
+
+	if (!rule) {
+		return ripcurl->Global.webkit_settings;
+	}
+
+	if ((settings = g_hash_table_lookup(ripcurl->Sites.settings, rule))) {
+		return settings;
+	}
+
+	settings = webkit_web_settings_copy(ripcurl->Global.webkit_settings);
+	if (rule->scripts != DEFAULT) {
+		g_object_set(G_OBJECT(settings), "enable-scripts", rule->scripts == ON, NULL);
+	}
+	if (rule->images != DEFAULT) {
+		g_object_set(G_OBJECT(settings), "auto-load-images", rule->images == ON, NULL);
+	}
+	if (rule->plugins != DEFAULT) {
+		g_object_set(G_OBJECT(settings), "enable-plugins", rule->plugins == ON, NULL);
+	}
+	g_hash_table_insert(ripcurl->Sites.settings, rule, settings);
+
+	return settings;
+}
+
+/*
+ * Return: settings with images, scripts and plugins turned off for lite
+ * mode, shared like the site settings they are made from
+ */
+WebKitWebSettings *sites_lite_settings(WebKitWebSettings *settings)
+{
+	WebKitWebSettings *lite;
+
+	if ((lite = g_hash_table_lookup(ripcurl->Sites.lite, settings))) {
+		return lite;
+	}
+
+	lite = webkit_web_settings_copy(settings);
+	g_object_set(G_OBJECT(lite), "auto-load-images", FALSE,
+			"enable-scripts", FALSE, "enable-plugins", FALSE, NULL);
+	g_hash_table_insert(ripcurl->Sites.lite, settings, lite);
+
+	return lite;
+}
+
+/*
+ * resolve the host of uri and open a connection to it ahead of time
+ *
+ * Preconnects are deduplicated per origin for preconnect_ttl seconds and,
+ * if limit is set, rate limited to preconnect_rate per second.
+ */
+void preconnect(const char *uri, gboolean limit)
+{
+	Preconnection *p;
+	SoupURI *suri;
+	SoupMessage *message;
+	char *origin, *root;
+	gint64 now;
+
+	if (ripcurl->Global.offline || !(origin = uri_origin(uri))) {
+		return;
+	}
+
+	now = g_get_monotonic_time();
+
+	p = g_hash_table_lookup(ripcurl->Preconnect.origins, origin);
+	if (p && now - p->time < preconnect_ttl * G_USEC_PER_SEC) {
+		/* connection is still warm */
+		ripcurl->Stats.preconnect_deduplicated++;
+		free(origin);
+		return;
+	}
+
+	if (limit) {
+		/* token bucket, refilled at preconnect_rate per second */
+		ripcurl->Preconnect.tokens = MIN(preconnect_rate, ripcurl->Preconnect.tokens
+				+ (double)(now - ripcurl->Preconnect.refill) * preconnect_rate / G_USEC_PER_SEC);
+		ripcurl->Preconnect.refill = now;
+
+		if (ripcurl->Preconnect.tokens < 1.0) {
+			ripcurl->Stats.preconnect_limited++;
+			free(origin);
+			return;
+		}
+		ripcurl->Preconnect.tokens -= 1.0;
+	}
+
+	/* dns */
+	suri = soup_uri_new(uri);
+	soup_session_prefetch_dns(ripcurl->Global.soup_session, suri->host, NULL, NULL, NULL);
+	soup_uri_free(suri);
+
+	/*
+	 * libsoup has no connect-only call, so send a HEAD for the root of the
+	 * origin - the connection (and TLS session) stays in the session's pool.
+	 * It carries no cookies and leaves the cache alone, the user has not
+	 * visited the site.
+	 */
+	root = strconcat(origin, "/", NULL);
+	if ((message = soup_message_new(SOUP_METHOD_HEAD, root))) {
+		soup_message_disable_feature(message, SOUP_TYPE_COOKIE_JAR);
+		soup_message_disable_feature(message, SOUP_TYPE_CACHE);
+		soup_message_set_priority(message, SOUP_MESSAGE_PRIORITY_VERY_LOW);
+		soup_session_queue_message(ripcurl->Global.soup_session, message, NULL, NULL);
+	}
+	free(root);
+
+	if (!p) {
+		p = emalloc(sizeof *p);
+		g_hash_table_insert(ripcurl->Preconnect.origins, origin, p);
+	} else {
+		free(origin);
+	}
+	p->time = now;
+	p->used = FALSE;
+
+	ripcurl->Stats.preconnect_issued++;
+}
+
+/*
+ * count whether a navigation found a warm connection
+ */
+void preconnect_navigated(const char *uri)
+{
+	Preconnection *p;
+	char *origin;
+
+	if (!hover_preconnect || private_browsing || !(origin = uri_origin(uri))) {
+		return;
+	}
+
+	p = g_hash_table_lookup(ripcurl->Preconnect.origins, origin);
+	if (p && !p->used && g_get_monotonic_time() - p->time < preconnect_ttl * G_USEC_PER_SEC) {
+		p->used = TRUE;
+		ripcurl->Stats.preconnect_hits++;
+	} else {
+		ripcurl->Stats.preconnect_misses++;
+	}
+
+	free(origin);
+}
+
+/*
+ * start resolving the first page's host before the profile is loaded
+ *
+ * The connection is left to preconnect_startup_connect(), once the
+ * offline state is known and the session has its cookie jar.
+ */
+void preconnect_startup(const char *uri)
+{
+	SoupURI *suri;
+
+	if (!uri || !(suri = soup_uri_new(uri))) {
+		return;
+	}
+
+	if (SOUP_URI_VALID_FOR_HTTP(suri)) {
+		soup_session_prefetch_dns(ripcurl->Global.soup_session, suri->host, NULL, NULL, NULL);
+		ripcurl->Preconnect.startup = strdup(uri);
+	}
+	soup_uri_free(suri);
+}
+
+/*
+ * connect to the first page once the cookie jar is in place, and for
+ * https the ca database as well - a tls handshake without it is wasted
+ */
+void preconnect_startup_connect(void)
+{
+	char *uri = ripcurl->Preconnect.startup;
+
+	if (!uri || !ripcurl->Load.cookies_applied
+			|| (!ripcurl->Load.tls_applied && g_str_has_prefix(uri, "https:"))) {
+		return;
+	}
+
+	/* taken first, the preconnect is queued like any other request */
+	ripcurl->Preconnect.startup = NULL;
+	preconnect(uri, FALSE);
+	free(uri);
+}
+
+/*
+ * fetch the document b's pointer rests on into the http cache, at low
+ * priority and within prefetch_budget bytes per minute
+ *
+ * Return: TRUE if a prefetch was started
+ */
+gboolean prefetch_start(Browser *b)
+{
+	SoupMessage *message;
+	char *origin;
+
+	if (!ripcurl->Global.soup_cache || ripcurl->Global.offline || b->Hover.message) {
+		return FALSE;
+	}
+
+	if (!(origin = uri_origin(b->Hover.uri))) {
+		/* not http(s) */
+		return FALSE;
+	}
+	free(origin);
+
+	prefetch_expire();
+
+	if (g_hash_table_lookup(ripcurl->Prefetch.uris, b->Hover.uri)) {
+		/* already prefetched */
+		return FALSE;
+	}
+
+	if (prefetch_budget_left() <= 0) {
+		ripcurl->Stats.prefetch_limited++;
+		return FALSE;
+	}
+
+	/* the prefetch is sent with the cookies the navigation will have */
+	cookies_apply();
+
+	/* only the document itself - it is never parsed for subresources */
+	if (!(message = soup_message_new(SOUP_METHOD_GET, b->Hover.uri))) {
+		return FALSE;
+	}
+	soup_message_headers_append(message->request_headers, "Purpose", "prefetch");
+	soup_message_headers_append(message->request_headers, "Accept", "text/html,application/xhtml+xml");
+	soup_message_set_priority(message, SOUP_MESSAGE_PRIORITY_VERY_LOW);
+
+	/* the cache keeps the body, there is no need to hold it in memory */
+	soup_message_set_flags(message, soup_message_get_flags(message) | SOUP_MESSAGE_OVERWRITE_CHUNKS);
+	g_signal_connect(G_OBJECT(message), "got-headers", G_CALLBACK(cb_soup_prefetch_got_headers), NULL);
+	g_signal_connect(G_OBJECT(message), "got-chunk", G_CALLBACK(cb_soup_prefetch_got_chunk), NULL);
+
+	b->Hover.message = message;
+	soup_session_queue_message(ripcurl->Global.soup_session, message, cb_soup_prefetch_finished, NULL);
+
+	ripcurl->Stats.prefetch_issued++;
+
+	return TRUE;
+}
+
+/*
+ * bytes that may still be prefetched in the current one minute window
+ */
+goffset prefetch_budget_left(void)
+{
+	gint64 now = g_get_monotonic_time();
+
+	if (now - ripcurl->Prefetch.window >= 60 * G_USEC_PER_SEC) {
+		/* start a new one minute window */
+		ripcurl->Prefetch.window = now;
+		ripcurl->Prefetch.bytes = 0;
+	}
+
+	return prefetch_budget - ripcurl->Prefetch.bytes;
+}
+
+/*
+ * stop a prefetch that is not a document or does not fit in the budget
+ */
+void prefetch_limit(SoupMessage *message)
+{
+	if (g_object_get_data(G_OBJECT(message), "ripcurl-prefetch-limited")) {
+		return;
+	}
+	g_object_set_data(G_OBJECT(message), "ripcurl-prefetch-limited", GINT_TO_POINTER(TRUE));
+	ripcurl->Stats.prefetch_limited++;
+
+	soup_session_cancel_message(ripcurl->Global.soup_session, message, SOUP_STATUS_CANCELLED);
+}
+
+void prefetch_cancel(Browser *b)
+{
+	if (b->Hover.message) {
+		soup_session_cancel_message(ripcurl->Global.soup_session, b->Hover.message, SOUP_STATUS_CANCELLED);
+		b->Hover.message = NULL;
+	}
+}
+
+/*
+ * count a navigation to a prefetched document as used
+ */
+void prefetch_navigated(const char *uri)
+{
+	if (uri && g_hash_table_remove(ripcurl->Prefetch.uris, uri)) {
+		ripcurl->Stats.prefetch_used++;
+	}
+}
+
+/*
+ * count prefetches not used within PREFETCH_TTL as wasted
+ */
+void prefetch_expire(void)
+{
+	GHashTableIter iter;
+	gpointer time;
+	gint64 now = g_get_monotonic_time();
+
+	g_hash_table_iter_init(&iter, ripcurl->Prefetch.uris);
+	while (g_hash_table_iter_next(&iter, NULL, &time)) {
+		if (now - *(gint64 *)time >= PREFETCH_TTL * G_USEC_PER_SEC) {
+			g_hash_table_iter_remove(&iter);
+			ripcurl->Stats.prefetch_wasted++;
+		}
+	}
+}
+
+/*
+ * estimate when a key event was generated, on the monotonic clock
+ *
+ * GdkEventKey timestamps come from the X server clock, which has an unknown
+ * offset from ours. The smallest difference seen so far is taken as the
+ * offset, so the estimate only ever errs towards shorter latencies.
+ */
+gint64 stats_event_time(GdkEventKey *event)
+{
+	static gint64 offset = G_MAXINT64;
+	gint64 now, diff;
+
+	now = g_get_monotonic_time();
+
+	if (!event || event->time == GDK_CURRENT_TIME) {
+		/* synthesized event - no timestamp */
+		return now;
+	}
+
+	diff = now - (gint64)event->time * 1000;
+	if (diff < offset) {
+		offset = diff;
+	}
+
+	return now - (diff - offset);
+}
+
+/*
+ * record the time from start until now as latency of action
+ */
+void stats_record_latency(char *action, gint64 start)
+{
+	Histogram *h;
+	gint64 latency = g_get_monotonic_time() - start;
+
+	if (!(h = g_hash_table_lookup(ripcurl->Stats.latency, action))) {
+		h = histogram_new();
+		g_hash_table_insert(ripcurl->Stats.latency, strdup(action), h);
+	}
+	histogram_record(h, latency);
+
+	/* all actions combined */
+	if (!(h = g_hash_table_lookup(ripcurl->Stats.latency, "*"))) {
+		h = histogram_new();
+		g_hash_table_insert(ripcurl->Stats.latency, strdup("*"), h);
+	}
+	histogram_record(h, latency);
+}
+
+void stats_print_latency(void)
+{
+	GList *actions, *list;
+	Histogram *h;
+
+	printf("%-16s %8s %10s %10s %10s %10s %10s\n", "latency (ms)",
+			"count", "mean", "p50", "p90", "p99", "max");
+
+	actions = g_list_sort(g_hash_table_get_keys(ripcurl->Stats.latency), (GCompareFunc)strcmp_s);
+
+	for (list = actions; list; list = g_list_next(list)) {
+		h = g_hash_table_lookup(ripcurl->Stats.latency, list->data);
+		printf("%-16s %8lu %10.3f %10.3f %10.3f %10.3f %10.3f\n", (char *)list->data,
+				h->total,
+				histogram_mean(h) / 1000.0,
+				histogram_percentile(h, 50.0) / 1000.0,
+				histogram_percentile(h, 90.0) / 1000.0,
+				histogram_percentile(h, 99.0) / 1000.0,
+				h->max / 1000.0);
+	}
+
+	g_list_free(actions);
+	fflush(stdout);
+}
+
+void stats_print_preconnect(void)
+{
+	unsigned long navigations;
+
+	navigations = ripcurl->Stats.preconnect_hits + ripcurl->Stats.preconnect_misses;
+
+	printf("preconnect: %lu issued, %lu deduplicated, %lu rate limited\n",
+			ripcurl->Stats.preconnect_issued, ripcurl->Stats.preconnect_deduplicated,
+			ripcurl->Stats.preconnect_limited);
+	printf("preconnect: %lu hits, %lu misses (%.0f%% of navigations warm)\n",
+			ripcurl->Stats.preconnect_hits, ripcurl->Stats.preconnect_misses,
+			navigations ? 100.0 * ripcurl->Stats.preconnect_hits / navigations : 0.0);
+	fflush(stdout);
+}
+
+void stats_print_prefetch(void)
+{
+	prefetch_expire();
+
+	printf("prefetch: %lu issued, %lu cancelled, %lu over budget or not html\n",
+			ripcurl->Stats.prefetch_issued, ripcurl->Stats.prefetch_cancelled,
+			ripcurl->Stats.prefetch_limited);
+	printf("prefetch: %lu used, %lu wasted, %u pending, %.1f KiB this minute\n",
+			ripcurl->Stats.prefetch_used, ripcurl->Stats.prefetch_wasted,
+			g_hash_table_size(ripcurl->Prefetch.uris), ripcurl->Prefetch.bytes / 1024.0);
+	fflush(stdout);
+}
+
+void stats_print_suspend(void)
+{
+	GList *list;
+	unsigned int suspended = 0;
+
+	for (list = ripcurl->Global.browsers; list; list = g_list_next(list)) {
+		if (((Browser *)list->data)->Suspend.suspended) {
+			suspended++;
+		}
+	}
+
+	printf("suspend: %u of %u windows suspended\n", suspended, g_list_length(ripcurl->Global.browsers));
+	printf("suspend: %lu idle, %lu over budget, %lu under memory pressure, %lu restored\n",
+			ripcurl->Stats.suspended_idle, ripcurl->Stats.suspended_budget,
+			ripcurl->Stats.suspended_memory, ripcurl->Stats.resumed);
+	fflush(stdout);
+}
+
+void stats_print_memory(void)
+{
+	static const char *levels[] = { "normal", "over soft limit", "over hard limit" };
+
+	printf("memory: %.1f MiB resident, %.1f MiB peak, %s, %lu trims\n",
+			resident_size() / 1048576.0, ripcurl->Memory.peak / 1048576.0,
+			levels[ripcurl->Memory.level], ripcurl->Memory.trims);
+	fflush(stdout);
+}
+
+void stats_print_blocklist(void)
+{
+	Histogram *h = ripcurl->Stats.blocklist_check;
+
+	printf("blocklist: %u rules, %lu of %lu requests blocked\n",
+			ripcurl->Global.blocklist ? blocklist_size(ripcurl->Global.blocklist) : 0,
+			ripcurl->Stats.blocked, h->total);
+	printf("blocklist: check mean %.3f us, p50 %.3f us, p99 %.3f us, max %.3f us\n",
+			histogram_mean(h) / 1000.0,
+			histogram_percentile(h, 50.0) / 1000.0,
+			histogram_percentile(h, 99.0) / 1000.0,
+			h->max / 1000.0);
+	fflush(stdout);
+}
+
+void stats_print_window(void)
+{
+	Histogram *h = ripcurl->Stats.window_time;
+
+	printf("window: %lu opened from the spare window, %lu built, spare %s\n",
+			ripcurl->Stats.spare_hits, ripcurl->Stats.spare_misses,
+			ripcurl->Spare.browser ? "ready" : "empty");
+	printf("window: time to window mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+			histogram_mean(h) / 1000.0,
+			histogram_percentile(h, 50.0) / 1000.0,
+			histogram_percentile(h, 99.0) / 1000.0,
+			h->max / 1000.0);
+	fflush(stdout);
+}
+
+void profile_init(gboolean enabled, gint64 start)
+{
+	ripcurl->Profile.enabled = enabled;
+	ripcurl->Profile.reported = ripcurl->Profile.painted = FALSE;
+	ripcurl->Profile.start = start;
+	ripcurl->Profile.main_thread = g_thread_self();
+	g_mutex_init(&ripcurl->Profile.lock);
+	ripcurl->Profile.phases = g_array_new(FALSE, FALSE, sizeof(ProfilePhase));
+}
+
+/*
+ * Return: cpu time used by the calling thread in us
+ */
+gint64 profile_cpu_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+void profile_begin(ProfilePhase *phase, const char *name)
+{
+	phase->name = name;
+	phase->start = g_get_monotonic_time();
+	phase->cpu = profile_cpu_time();
+}
+
+/*
+ * add a finished phase to the report, safe to call from workers
+ */
+void profile_end(ProfilePhase *phase)
+{
+	if (!ripcurl->Profile.enabled) {
+		return;
+	}
+
+	phase->wall = g_get_monotonic_time() - phase->start;
+	phase->cpu = profile_cpu_time() - phase->cpu;
+	phase->start -= ripcurl->Profile.start;
+	phase->worker = (g_thread_self() != ripcurl->Profile.main_thread);
+
+	g_mutex_lock(&ripcurl->Profile.lock);
+	g_array_append_val(ripcurl->Profile.phases, *phase);
+	g_mutex_unlock(&ripcurl->Profile.lock);
+}
+
+/*
+ * report once the first page is painted and the workers' phases are all in
+ */
+void profile_check(void)
+{
+	if (ripcurl->Profile.enabled && !ripcurl->Profile.reported
+			&& ripcurl->Profile.painted && ripcurl->Load.pending == 0) {
+		profile_report();
+	}
+}
+
+gint profile_compare(gconstpointer a, gconstpointer b)
+{
+	gint64 d = ((const ProfilePhase *)a)->start - ((const ProfilePhase *)b)->start;
+
+	return (d > 0) - (d < 0);
+}
+
+/*
+ * print the startup phases as a table to stderr and as JSON to stdout
+ */
+void profile_report(void)
+{
+	ProfilePhase *p;
+	unsigned int i;
+
+	ripcurl->Profile.reported = TRUE;
+
+	g_mutex_lock(&ripcurl->Profile.lock);
+	g_array_sort(ripcurl->Profile.phases, profile_compare);
+
+	print_err("%-20s %10s %10s %10s  %s\n", "startup (ms)", "start", "wall", "cpu", "thread");
+	for (i = 0; i < ripcurl->Profile.phases->len; i++) {
+		p = &g_array_index(ripcurl->Profile.phases, ProfilePhase, i);
+		print_err("%-20s %10.3f %10.3f %10.3f  %s\n", p->name, p->start / 1000.0,
+				p->wall / 1000.0, p->cpu / 1000.0, p->worker ? "worker" : "main");
+	}
+
+	printf("{\"phases\": [");
+	for (i = 0; i < ripcurl->Profile.phases->len; i++) {
+		p = &g_array_index(ripcurl->Profile.phases, ProfilePhase, i);
+		printf("%s{\"name\": \"%s\", \"start_ms\": %.3f, \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"thread\": \"%s\"}",
+				i ? ", " : "", p->name, p->start / 1000.0, p->wall / 1000.0, p->cpu / 1000.0,
+				p->worker ? "worker" : "main");
+	}
+	printf("]}\n");
+	fflush(stdout);
+
+	g_mutex_unlock(&ripcurl->Profile.lock);
+}
+
+/*
+ * log input events to filename, one per line:
+ * "<ms since start> <type> [data]"
+ */
+void record_start(char *filename)
+{
+	if (!(ripcurl->Record.file = fopen(filename, "w"))) {
+		print_err("unable to open record file \"%s\"\n", filename);
+		return;
+	}
+
+	/* keep the log usable if ripcurl is killed */
+	setvbuf(ripcurl->Record.file, NULL, _IOLBF, 0);
+
+	fprintf(ripcurl->Record.file, "# ripcurl input recording\n");
+	ripcurl->Record.start = g_get_monotonic_time();
+}
+
+void record_event(char *type, char *data)
+{
+	gint64 ms;
+
+	if (!ripcurl->Record.file) {
+		return;
+	}
+
+	ms = (g_get_monotonic_time() - ripcurl->Record.start) / 1000;
+	fprintf(ripcurl->Record.file, "%" G_GINT64_FORMAT " %s%s%s\n", ms, type,
+			data ? " " : "", data ? data : "");
+}
+
+void record_key(char *type, GdkEventKey *event)
+{
+	char *data;
+	const char *name;
+
+	if (!ripcurl->Record.file || !(name = gdk_keyval_name(event->keyval))) {
+		return;
+	}
+
+	asprintf(&data, "%s 0x%x", name, event->state & ALL_MASK);
+	record_event(type, data);
+	free(data);
+}
+
+void record_stop(void)
+{
+	if (ripcurl->Record.file && fclose(ripcurl->Record.file)) {
+		print_err("unable to close record file\n");
+	}
+	ripcurl->Record.file = NULL;
+}
+
+/*
+ * inject events from a recording made with record_start
+ *
+ * speed scales the recorded pacing; 0 replays as fast as possible.
+ * "load" events wait for a page load to finish before continuing.
+ */
+void replay_start(char *filename, double speed)
+{
+	GList *lines, *list;
+	ReplayEvent *e;
+	gint64 time;
+	char type[16];
+	int n;
+
+	lines = g_list_reverse(read_file(filename, NULL));
+	if (!lines) {
+		print_err("unable to read replay file \"%s\"\n", filename);
+		return;
+	}
+
+	for (list = lines; list; list = g_list_next(list)) {
+		if (((char *)list->data)[0] == '#') {
+			/* comment */
+			continue;
+		}
+
+		n = 0;
+		if (sscanf(list->data, "%" G_GINT64_FORMAT " %15s %n", &time, type, &n) < 2) {
+			print_err("invalid replay event \"%s\"\n", (char *)list->data);
+			continue;
+		}
+
+		e = emalloc(sizeof *e);
+		e->time = time;
+		e->type = strdup(type);
+		e->data = n > 0 ? strdup((char *)list->data + n) : strdup("");
+		ripcurl->Replay.events = g_list_prepend(ripcurl->Replay.events, e);
+	}
+
+	for (list = lines; list; list = g_list_next(list)) {
+		free(list->data);
+	}
+	g_list_free(lines);
+
+	ripcurl->Replay.events = g_list_reverse(ripcurl->Replay.events);
+	ripcurl->Replay.next = ripcurl->Replay.events;
+	ripcurl->Replay.speed = speed;
+	ripcurl->Replay.start = g_get_monotonic_time();
+
+	if (ripcurl->Replay.next) {
+		e = ripcurl->Replay.next->data;
+		ripcurl->Replay.timeout = g_timeout_add_full(G_PRIORITY_LOW,
+				speed > 0 ? e->time / speed : 0, replay_next, NULL, NULL);
+	}
+}
+
+gboolean replay_next(gpointer data)
+{
+	ReplayEvent *e, *n;
+	Browser *b = NULL;
+	GList *list;
+	gint64 elapsed;
+
+	ripcurl->Replay.timeout = 0;
+
+	if (!ripcurl->Replay.next || !ripcurl->Global.browsers) {
+		return FALSE;
+	}
+
+	e = ripcurl->Replay.next->data;
+
+	if (!strcmp(e->type, "load")) {
+		if (ripcurl->Replay.loads == 0 && !ripcurl->Replay.timed_out) {
+			/* wait for page load */
+			ripcurl->Replay.waiting = TRUE;
+			ripcurl->Replay.timeout = g_timeout_add_seconds(REPLAY_LOAD_TIMEOUT,
+					replay_load_timeout, NULL);
+			return FALSE;
+		}
+
+		if (ripcurl->Replay.loads > 0) {
+			ripcurl->Replay.loads--;
+		}
+		ripcurl->Replay.timed_out = FALSE;
+	} else {
+		/* events go to the active window, or the newest one */
+		for (list = ripcurl->Global.browsers; list && !b; list = g_list_next(list)) {
+			if (gtk_window_is_active(GTK_WINDOW(((Browser *)list->data)->UI.window))) {
+				b = list->data;
+			}
+		}
+		if (!b) {
+			b = ripcurl->Global.browsers->data;
+		}
+		browser_resume(b);
+
+		if (!strcmp(e->type, "key") || !strcmp(e->type, "ikey")) {
+			replay_key(b, e->data);
+		} else if (!strcmp(e->type, "cmd")) {
+			browser_notify(b, DEFAULT, e->data);
+			gtk_widget_activate(GTK_WIDGET(b->UI.inputbar));
+		} else {
+			print_err("unknown replay event \"%s\"\n", e->type);
+		}
+	}
+
+	ripcurl->Replay.next = g_list_next(ripcurl->Replay.next);
+
+	if (ripcurl->Replay.next) {
+		n = ripcurl->Replay.next->data;
+		/* low priority, so pending redraws are not starved */
+		ripcurl->Replay.timeout = g_timeout_add_full(G_PRIORITY_LOW,
+				ripcurl->Replay.speed > 0 ? (n->time - e->time) / ripcurl->Replay.speed : 0,
+				replay_next, NULL, NULL);
+	} else {
+		elapsed = g_get_monotonic_time() - ripcurl->Replay.start;
+		printf("replay finished: %u events in %.1f ms (recorded %" G_GINT64_FORMAT " ms)\n",
+				g_list_length(ripcurl->Replay.events), elapsed / 1000.0, e->time);
+		fflush(stdout);
+	}
+
+	return FALSE;
+}
+
+gboolean replay_load_timeout(gpointer data)
+{
+	print_err("replay: no page load after %d seconds, continuing\n", REPLAY_LOAD_TIMEOUT);
+
+	ripcurl->Replay.timeout = 0;
+	ripcurl->Replay.waiting = FALSE;
+	ripcurl->Replay.timed_out = TRUE;
+
+	return replay_next(NULL);
+}
+
+/*
+ * send a synthesized key press ("<keyname> <state>") to the toplevel window
+ * of b, so that it takes the same path as a real one
+ */
+void replay_key(Browser *b, char *data)
+{
+	GdkEvent *event;
+	GdkKeymapKey *keys;
+	char name[64];
+	unsigned int state;
+	int n;
+
+	if (sscanf(data, "%63s %x", name, &state) < 2) {
+		print_err("invalid replay key \"%s\"\n", data);
+		return;
+	}
+
+	event = gdk_event_new(GDK_KEY_PRESS);
+	event->key.window = g_object_ref(gtk_widget_get_window(b->UI.window));
+	event->key.send_event = TRUE;
+	event->key.time = GDK_CURRENT_TIME;
+	event->key.state = state;
+	event->key.keyval = gdk_keyval_from_name(name);
+
+	/* shortcuts are matched on the hardware keycode */
+	if (gdk_keymap_get_entries_for_keyval(ripcurl->Global.keymap, event->key.keyval, &keys, &n)) {
+		event->key.hardware_keycode = keys[0].keycode;
+		event->key.group = keys[0].group;
+		g_free(keys);
+	}
+
+	gtk_main_do_event(event);
+	gdk_event_free(event);
+}
+
+void replay_load_finished(void)
+{
+	ripcurl->Replay.loads++;
+
+	if (ripcurl->Replay.waiting) {
+		ripcurl->Replay.waiting = FALSE;
+		g_source_remove(ripcurl->Replay.timeout);
+		ripcurl->Replay.timeout = g_timeout_add_full(G_PRIORITY_LOW, 0, replay_next, NULL, NULL);
+	}
+}
+
+void replay_stop(void)
+{
+	GList *list;
+	ReplayEvent *e;
+
+	if (ripcurl->Replay.timeout) {
+		g_source_remove(ripcurl->Replay.timeout);
+	}
+
+	for (list = ripcurl->Replay.events; list; list = g_list_next(list)) {
+		e = list->data;
+		free(e->type);
+		free(e->data);
+		free(e);
+	}
+	g_list_free(ripcurl->Replay.events);
+	ripcurl->Replay.events = ripcurl->Replay.next = NULL;
+}
+
+void ripcurl_init(void)
+{
+	/* webkit settings */
+	ripcurl->Global.webkit_settings = webkit_web_settings_new();
+
+	/* libsoup session */
+	ripcurl->Global.soup_session = webkit_get_default_session();
+	ripcurl->Global.soup_cache = NULL;
+	ripcurl->Global.cache_dump = 0;
+
+	/* offline mode */
+	ripcurl->Global.network_monitor = NULL;
+	ripcurl->Global.offline = FALSE;
+	ripcurl->Global.offline_mode = FALSE;
+
+	/* browser list */
+	ripcurl->Global.browsers = NULL;
+
+	/* bookmarks list */
+	ripcurl->Global.bookmarks = NULL;
+
+	/* history, bounded by history_limit and history_max_age */
+	ripcurl->Global.history = history_new(history_limit, (gint64)history_max_age * 86400);
+
+	/* full-text index of visited pages, opened in load_data */
+	ripcurl->Global.index = NULL;
+
+	/* command history list */
+	ripcurl->Global.command_history = NULL;
+
+	/* GDK keymap */
+	ripcurl->Global.keymap = gdk_keymap_get_default();
+
+	/* history, bookmarks and sessions are written on their own thread */
+	ripcurl->Global.writer = writer_new();
+
+	/* latency histograms, keyed by action */
+	ripcurl->Stats.latency = g_hash_table_new_full(g_str_hash, g_str_equal,
+			free, (GDestroyNotify)histogram_free);
+	ripcurl->Stats.cache_hits = ripcurl->Stats.cache_revalidated = ripcurl->Stats.cache_misses = 0;
+
+	/* preconnects, keyed by origin */
+	ripcurl->Preconnect.origins = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+	ripcurl->Preconnect.tokens = preconnect_rate;
+	ripcurl->Preconnect.refill = g_get_monotonic_time();
+	ripcurl->Preconnect.startup = NULL;
+	ripcurl->Stats.preconnect_issued = ripcurl->Stats.preconnect_deduplicated = 0;
+	ripcurl->Stats.preconnect_limited = 0;
+	ripcurl->Stats.preconnect_hits = ripcurl->Stats.preconnect_misses = 0;
+
+	/* prefetched documents, keyed by uri */
+	ripcurl->Prefetch.uris = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, free);
+	ripcurl->Prefetch.window = 0;
+	ripcurl->Prefetch.bytes = 0;
+	ripcurl->Stats.prefetch_issued = ripcurl->Stats.prefetch_used = 0;
+	ripcurl->Stats.prefetch_wasted = ripcurl->Stats.prefetch_cancelled = 0;
+	ripcurl->Stats.prefetch_limited = 0;
+
+	/* window suspension */
+	ripcurl->Stats.suspended_idle = ripcurl->Stats.suspended_budget = 0;
+	ripcurl->Stats.resumed = 0;
+	ripcurl->Global.suspend_check = 0;
+	ripcurl->Session.closed = FALSE;
+
+	/* startup loads, see load_data() */
+	g_mutex_init(&ripcurl->Load.lock);
+	g_cond_init(&ripcurl->Load.loaded);
+	ripcurl->Load.pending = 0;
+	ripcurl->Load.tls_ready = ripcurl->Load.tls_applied = FALSE;
+	ripcurl->Load.tls_database = NULL;
+	ripcurl->Load.cookies_ready = FALSE;
+	ripcurl->Load.cookies_applied = TRUE;
+	ripcurl->Load.cookie_jar = NULL;
+	ripcurl->Load.history_legacy = FALSE;
+	if (suspend_ttl > 0 || live_windows > 0) {
+		ripcurl->Global.suspend_check = g_timeout_add_seconds(SUSPEND_INTERVAL, suspend_check, NULL);
+	}
+
+	/* memory pressure */
+	ripcurl->Stats.suspended_memory = 0;
+	ripcurl->Memory.level = 0;
+	ripcurl->Memory.peak = 0;
+	ripcurl->Memory.trims = 0;
+	ripcurl->Memory.timer = 0;
+	if (memory_soft_limit > 0 || memory_hard_limit > 0) {
+		ripcurl->Memory.timer = g_timeout_add_seconds(MEMORY_INTERVAL, memory_check, NULL);
+	}
+
+	/* content blocking, check times in ns */
+	ripcurl->Global.blocklist = NULL;
+	ripcurl->Stats.blocked = 0;
+	ripcurl->Stats.blocklist_check = histogram_new();
+
+	/* spare window, time to window in us */
+	ripcurl->Spare.browser = NULL;
+	ripcurl->Spare.idle = 0;
+	ripcurl->Stats.spare_hits = ripcurl->Stats.spare_misses = 0;
+	ripcurl->Stats.window_time = histogram_new();
+
+	/* input recording and replay */
+	ripcurl->Record.file = NULL;
+	ripcurl->Replay.events = ripcurl->Replay.next = NULL;
+	ripcurl->Replay.loads = 0;
+	ripcurl->Replay.timeout = 0;
+	ripcurl->Replay.waiting = ripcurl->Replay.timed_out = FALSE;
+
+	/* create config dir */
+	ripcurl->Files.config_dir = g_build_filename(g_get_user_config_dir(), "ripcurl", NULL);
+	g_mkdir_with_parents(ripcurl->Files.config_dir, 0771);
+}
+
+void load_data(void)
+{
+	/*
+	 * cookies, ca database, blocklists, bookmarks and history are read on
+	 * worker threads - each becomes available when its callback runs
+	 */
+
+	/* load cookies */
+	if (!private_browsing) {
+		ripcurl->Files.cookie_file = g_build_filename(ripcurl->Files.config_dir, cookie_file, NULL);
+		if (!ripcurl->Files.cookie_file) {
+			print_err("error building cookie file path\n");
+		} else {
+			ripcurl->Load.cookies_applied = FALSE;
+			load_start(cookies_load, cb_cookies_loaded);
+		}
+	}
+
+	/* ssl */
+	load_start(tls_load, cb_tls_loaded);
+
+	g_signal_connect(G_OBJECT(ripcurl->Global.soup_session), "request-queued", G_CALLBACK(cb_soup_request_queued), NULL);
+	g_object_set(G_OBJECT(ripcurl->Global.soup_session), "ssl-strict", strict_ssl, NULL);
+
+	/* http cache */
+	ripcurl->Files.cache_dir = NULL;
+	if (!private_browsing && cache_size > 0) {
+		ripcurl->Files.cache_dir = g_build_filename(ripcurl->Files.config_dir, cache_dir, NULL);
+		if (!ripcurl->Files.cache_dir) {
+			print_err("error building cache dir path\n");
+		} else {
+			ripcurl->Global.soup_cache = soup_cache_new(ripcurl->Files.cache_dir, SOUP_CACHE_SINGLE_USER);
+			soup_cache_set_max_size(ripcurl->Global.soup_cache, MIN((goffset)cache_size * 1024 * 1024, G_MAXUINT));
+			soup_session_add_feature(ripcurl->Global.soup_session, SOUP_SESSION_FEATURE(ripcurl->Global.soup_cache));
+			soup_cache_load(ripcurl->Global.soup_cache);
+
+			g_signal_connect(G_OBJECT(ripcurl->Global.soup_session), "request-started", G_CALLBACK(cb_soup_request_started), NULL);
+			g_signal_connect(G_OBJECT(ripcurl->Global.soup_session), "request-unqueued", G_CALLBACK(cb_soup_request_unqueued), NULL);
+
+			/* offline mode */
+			ripcurl->Global.network_monitor = g_network_monitor_get_default();
+			g_signal_connect(G_OBJECT(ripcurl->Global.network_monitor), "network-changed", G_CALLBACK(cb_network_changed), NULL);
+
+			if (offline_detect) {
+				ripcurl->Global.offline_mode = AUTO;
+				offline_set(!g_network_monitor_get_network_available(ripcurl->Global.network_monitor));
+			}
+		}
+	}
+
+	/* session */
+	ripcurl->Files.session_file = NULL;
+	if (!private_browsing) {
+		ripcurl->Files.session_file = g_build_filename(ripcurl->Files.config_dir, session_file, NULL);
+		if (!ripcurl->Files.session_file) {
+			print_err("error building session file path\n");
+		}
+	}
+
+	/* load blocklists */
+	load_start(blocklist_load_files, cb_blocklist_loaded);
+
+	/* load bookmarks */
+	ripcurl->Files.bookmarks_file = g_build_filename(ripcurl->Files.config_dir, bookmarks_file, NULL);
+	if (!ripcurl->Files.bookmarks_file) {
 		print_err("error building bookmarks file path\n");
 	} else {
-		ripcurl->Global.bookmarks = read_file(ripcurl->Files.bookmarks_file, ripcurl->Global.bookmarks);
-		ripcurl->Global.bookmarks= g_list_reverse(ripcurl->Global.bookmarks);
+		load_start(bookmarks_load, cb_bookmarks_loaded);
 	}
 
 	/* load history */
@@ -1375,8 +4390,32 @@ void load_data(void)
 	if (!ripcurl->Files.history_file) {
 		print_err("error building history file path\n");
 	} else {
-		ripcurl->Global.history = read_file(ripcurl->Files.history_file, ripcurl->Global.history);
+		load_start(history_load, cb_history_loaded);
+	}
+
+	/* full-text index, loaded on its own thread */
+	ripcurl->Files.index_file = NULL;
+	if (history_index && !private_browsing) {
+		ripcurl->Files.index_file = g_build_filename(ripcurl->Files.config_dir, index_file, NULL);
+		if (!ripcurl->Files.index_file) {
+			print_err("error building index file path\n");
+		} else {
+			ripcurl->Global.index = index_new(ripcurl->Files.index_file);
+			history_set_evict_func(ripcurl->Global.history, history_evicted, NULL);
+		}
+	}
+
+	/* autosave */
+	ripcurl->Autosave.session = FALSE;
+	ripcurl->Autosave.history = ripcurl->Autosave.bookmarks = FALSE;
+	ripcurl->Autosave.timer = 0;
+	if (autosave_interval > 0) {
+		ripcurl->Autosave.timer = g_timeout_add_seconds(autosave_interval, autosave, NULL);
 	}
+
+	/* quit cleanly on SIGTERM and SIGINT */
+	g_unix_signal_add(SIGTERM, cb_signal_quit, NULL);
+	g_unix_signal_add(SIGINT, cb_signal_quit, NULL);
 }
 
 void ripcurl_settings(void)
@@ -1386,6 +4425,9 @@ void ripcurl_settings(void)
 	}
 	g_object_set(G_OBJECT(ripcurl->Global.webkit_settings), "enable-developer-extras", developer_extras, NULL);
 	g_object_set(G_OBJECT(ripcurl->Global.webkit_settings), "enable-private-browsing", private_browsing, NULL);
+
+	/* per-site settings */
+	sites_init();
 }
 
 void ripcurl_style(void)
@@ -1410,17 +4452,55 @@ void cleanup(void)
 {
 	GList *list;
 
+	if (ripcurl->Global.suspend_check) {
+		g_source_remove(ripcurl->Global.suspend_check);
+	}
+	if (ripcurl->Memory.timer) {
+		g_source_remove(ripcurl->Memory.timer);
+	}
+	if (ripcurl->Autosave.timer) {
+		g_source_remove(ripcurl->Autosave.timer);
+	}
+
 	/* destroy any remaining browsers */
+	spare_drop();
 	while (ripcurl->Global.browsers) {
 		browser_destroy(ripcurl->Global.browsers->data);
 	}
 	g_list_free(ripcurl->Global.browsers);
 
-	/* free cookie file */
+	/* wait for startup loads - their data is written below */
+	while (ripcurl->Load.pending > 0) {
+		g_main_context_iteration(NULL, TRUE);
+	}
+
+	/* no page was painted */
+	if (ripcurl->Profile.enabled && !ripcurl->Profile.reported) {
+		profile_report();
+	}
+	g_array_free(ripcurl->Profile.phases, TRUE);
+
+	/* free ca database */
+	if (ripcurl->Load.tls_database) {
+		g_object_unref(ripcurl->Load.tls_database);
+	}
+
+	/* free cookie and session file */
 	g_free(ripcurl->Files.cookie_file);
+	g_free(ripcurl->Files.session_file);
+
+	/* write cache */
+	if (ripcurl->Global.soup_cache) {
+		if (ripcurl->Global.cache_dump) {
+			g_source_remove(ripcurl->Global.cache_dump);
+		}
+		cache_dump(NULL);
+		g_object_unref(ripcurl->Global.soup_cache);
+	}
+	g_free(ripcurl->Files.cache_dir);
 
 	/* write bookmarks */
-	if (ripcurl->Files.bookmarks_file) {
+	if (ripcurl->Autosave.bookmarks && ripcurl->Files.bookmarks_file) {
 		bookmarks_write();
 	}
 
@@ -1432,36 +4512,81 @@ void cleanup(void)
 	g_free(ripcurl->Files.bookmarks_file);
 
 	/* write history */
-	if (ripcurl->Files.history_file) {
+	if (ripcurl->Autosave.history && ripcurl->Files.history_file) {
 		history_write();
 	}
 
 	/* clear history */
-	for (list = ripcurl->Global.history; list; list = g_list_next(list)) {
-		free(list->data);
-	}
-	g_list_free(ripcurl->Global.history);
+	history_free(ripcurl->Global.history);
 	g_free(ripcurl->Files.history_file);
 
+	/* finish queued pages and close the index */
+	if (ripcurl->Global.index) {
+		index_free(ripcurl->Global.index);
+	}
+	g_free(ripcurl->Files.index_file);
+
 	/* free config dir file */
 	g_free(ripcurl->Files.config_dir);
 
 	/* free font */
 	pango_font_description_free(ripcurl->Style.font);
 
+	/* free statistics */
+	g_hash_table_destroy(ripcurl->Stats.latency);
+	histogram_free(ripcurl->Stats.blocklist_check);
+	histogram_free(ripcurl->Stats.window_time);
+
+	/* free blocklist */
+	blocklist_free(ripcurl->Global.blocklist);
+
+	/* free site settings */
+	site_node_free(ripcurl->Sites.root);
+	g_hash_table_destroy(ripcurl->Sites.settings);
+	g_hash_table_destroy(ripcurl->Sites.lite);
+
+	/* free preconnects and prefetches */
+	free(ripcurl->Preconnect.startup);
+	g_hash_table_destroy(ripcurl->Preconnect.origins);
+	g_hash_table_destroy(ripcurl->Prefetch.uris);
+
+	/* stop recording and replay */
+	record_stop();
+	replay_stop();
+
+	/* wait for the queued writes */
+	writer_free(ripcurl->Global.writer);
+
 	free(ripcurl);
 }
 
 int main(int argc, char *argv[])
 {
 	Browser *b;
+	ProfilePhase phase;
 	char **arg, *uri = NULL;
+	char *record_file = NULL, *replay_file = NULL;
+	double replay_speed = 1.0;
+	gboolean restore = FALSE, profile = FALSE;
+	gint64 start;
 
+	start = g_get_monotonic_time();
+	profile_begin(&phase, "gtk_init");
 	gtk_init(&argc, &argv);
 
 	for (arg = argv+1; *arg; arg++) {
 		if (strcmp_s(*arg, "-p") == 0) {
 			private_browsing = TRUE;
+		} else if (strcmp_s(*arg, "--record") == 0 && arg[1]) {
+			record_file = *++arg;
+		} else if (strcmp_s(*arg, "--replay") == 0 && arg[1]) {
+			replay_file = *++arg;
+		} else if (strcmp_s(*arg, "--replay-speed") == 0 && arg[1]) {
+			replay_speed = strtod(*++arg, NULL);
+		} else if (strcmp_s(*arg, "--restore") == 0) {
+			restore = TRUE;
+		} else if (strcmp_s(*arg, "--startup-profile") == 0) {
+			profile = TRUE;
 		} else {
 			uri = *arg;
 			break;
@@ -1470,19 +4595,55 @@ int main(int argc, char *argv[])
 
 	/* init toplevel struct */
 	ripcurl = emalloc(sizeof *ripcurl);
+	profile_init(profile, start);
+	profile_end(&phase);
+
+	profile_begin(&phase, "ripcurl_init");
 	ripcurl_init();
+	profile_end(&phase);
+
+	profile_begin(&phase, "ripcurl_settings");
 	ripcurl_settings();
+	profile_end(&phase);
+
+	profile_begin(&phase, "ripcurl_style");
 	ripcurl_style();
-	
+	profile_end(&phase);
+
+	/* overlap the first page's dns lookup and connect with the loads */
+	if (!restore || uri) {
+		preconnect_startup(uri ? uri : home_page);
+	}
+
+	/* the loads themselves run on workers and are timed there */
+	profile_begin(&phase, "load_data");
 	load_data();
+	profile_end(&phase);
 
-	/* init first browser window */
-	b = browser_new();
+	preconnect_startup_connect();
 
-	if (uri) {
-		browser_load_uri(b, uri);
-	} else {
-		browser_load_uri(b, home_page);
+	/* input recording and replay - before the first page load */
+	if (record_file) {
+		record_start(record_file);
+	}
+	if (replay_file) {
+		replay_start(replay_file, replay_speed);
+	}
+
+	profile_begin(&ripcurl->Profile.first_paint, "first_paint");
+
+	/* restore the last session, an uri given opens in a window of its own */
+	if (!(restore && session_restore(!uri) > 0) || uri) {
+		/* init first browser window */
+		profile_begin(&phase, "browser_new");
+		b = browser_new();
+		profile_end(&phase);
+
+		if (uri) {
+			browser_load_uri(b, uri);
+		} else {
+			browser_load_uri(b, home_page);
+		}
 	}
 
 	/* start GTK+ main loop */
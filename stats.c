@@ -0,0 +1,124 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "utils.h"
+#include "stats.h"
+
+/*
+ * find bucket for value
+ *
+ * Return: none
+ */
+static void histogram_index(gint64 value, int *magnitude, int *sub)
+{
+	int m;
+
+	if (value < HIST_SUB_BUCKETS) {
+		*magnitude = 0;
+		*sub = value;
+		return;
+	}
+
+	/* values in magnitude m lie in [16 << (m-1), 32 << (m-1)) */
+	m = g_bit_storage(value) - g_bit_storage(HIST_SUB_BUCKETS - 1);
+
+	if (m >= HIST_MAGNITUDES) {
+		/* clamp to the largest bucket */
+		*magnitude = HIST_MAGNITUDES - 1;
+		*sub = HIST_SUB_BUCKETS - 1;
+		return;
+	}
+
+	*magnitude = m;
+	*sub = (value >> (m - 1)) - HIST_SUB_BUCKETS;
+}
+
+/*
+ * get the lowest value that maps to a bucket
+ *
+ * Return: lower bound of bucket
+ */
+static gint64 histogram_bucket_value(int magnitude, int sub)
+{
+	if (magnitude == 0) {
+		return sub;
+	}
+
+	return (gint64)(HIST_SUB_BUCKETS + sub) << (magnitude - 1);
+}
+
+Histogram *histogram_new(void)
+{
+	Histogram *h;
+
+	h = emalloc(sizeof *h);
+	memset(h, 0, sizeof *h);
+	h->min = G_MAXINT64;
+
+	return h;
+}
+
+void histogram_record(Histogram *h, gint64 value)
+{
+	int m, s;
+
+	if (value < 0) {
+		value = 0;
+	}
+
+	histogram_index(value, &m, &s);
+	h->counts[m][s]++;
+	h->total++;
+	h->sum += value;
+
+	if (value < h->min) {
+		h->min = value;
+	}
+	if (value > h->max) {
+		h->max = value;
+	}
+}
+
+/*
+ * get value at percentile (0-100)
+ *
+ * Return: lower bound of the bucket holding the percentile, clamped to the
+ * recorded range; 0 if the histogram is empty
+ */
+gint64 histogram_percentile(Histogram *h, double percentile)
+{
+	unsigned long rank, seen;
+	int m, s;
+
+	if (h->total == 0) {
+		return 0;
+	}
+
+	rank = (unsigned long)(percentile / 100.0 * h->total + 0.5);
+	if (rank < 1) {
+		rank = 1;
+	}
+
+	for (m = 0, seen = 0; m < HIST_MAGNITUDES; m++) {
+		for (s = 0; s < HIST_SUB_BUCKETS; s++) {
+			seen += h->counts[m][s];
+			if (seen >= rank) {
+				return CLAMP(histogram_bucket_value(m, s), h->min, h->max);
+			}
+		}
+	}
+
+	return h->max;
+}
+
+gint64 histogram_mean(Histogram *h)
+{
+	return h->total ? h->sum / (gint64)h->total : 0;
+}
+
+void histogram_free(Histogram *h)
+{
+	free(h);
+}
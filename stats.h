@@ -0,0 +1,28 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+/*
+ * log-linear (HDR-style) histogram: values below HIST_SUB_BUCKETS are
+ * counted exactly, larger values land in one of HIST_SUB_BUCKETS linear
+ * buckets per power of two, for a relative error of at most 1/16.
+ */
+#define HIST_SUB_BUCKETS	16
+#define HIST_MAGNITUDES		32
+
+typedef struct _Histogram Histogram;
+
+struct _Histogram {
+	unsigned long counts[HIST_MAGNITUDES][HIST_SUB_BUCKETS];
+	unsigned long total;
+	gint64 min;
+	gint64 max;
+	gint64 sum;
+};
+
+Histogram *histogram_new(void);
+void histogram_record(Histogram *h, gint64 value);
+gint64 histogram_percentile(Histogram *h, double percentile);
+gint64 histogram_mean(Histogram *h);
+void histogram_free(Histogram *h);
+
+#endif /* __STATS_H__ */
@@ -2,8 +2,10 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <glib.h>
+#include <glib/gstdio.h>
 
 #include "utils.h"
 
@@ -415,6 +417,57 @@ GList *read_file(char *filename, GList *list)
 	return list;
 }
 
+/*
+ * get the total size of the regular files in a directory (not recursive)
+ *
+ * Return: size in bytes, 0 if the directory cannot be read
+ */
+goffset dir_size(char *path)
+{
+	GDir *dir;
+	GStatBuf st;
+	const char *name;
+	char *filename;
+	goffset size = 0;
+
+	if (!path || !(dir = g_dir_open(path, 0, NULL))) {
+		return 0;
+	}
+
+	while ((name = g_dir_read_name(dir))) {
+		filename = g_build_filename(path, name, NULL);
+		if (!g_stat(filename, &st) && S_ISREG(st.st_mode)) {
+			size += st.st_size;
+		}
+		g_free(filename);
+	}
+
+	g_dir_close(dir);
+
+	return size;
+}
+
+/*
+ * Return: resident set size of this process in bytes, -1 if unknown
+ */
+goffset resident_size(void)
+{
+	FILE *fp;
+	long pages;
+
+	if (!(fp = fopen("/proc/self/statm", "r"))) {
+		return -1;
+	}
+
+	/* "<total> <resident> ..." in pages */
+	if (fscanf(fp, "%*s %ld", &pages) != 1) {
+		pages = -1;
+	}
+	fclose(fp);
+
+	return (pages < 0) ? -1 : (goffset)pages * sysconf(_SC_PAGESIZE);
+}
+
 /* TODO */
 char *build_path(char *arg)
 {
@@ -13,6 +13,8 @@ unsigned int strlenv(char **strv);
 void strfreev(char **strv);
 char *strjoinv(char **strv, const char *separator);
 GList *read_file(char *filename, GList *list);
+goffset dir_size(char *path);
+goffset resident_size(void);
 
 #define die(fmt, ...)	{ print_err(fmt, ##__VA_ARGS__); exit(EXIT_FAILURE); }
 
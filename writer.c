@@ -0,0 +1,191 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "utils.h"
+#include "writer.h"
+
+typedef struct _WriteJob WriteJob;
+
+enum { JOB_WRITE, JOB_STOP };
+
+struct _WriteJob {
+	int type;
+	char *filename;
+	GString *data;
+	unsigned long serial;
+};
+
+struct _Writer {
+	GThread *thread;
+	GAsyncQueue *queue;
+	GMutex lock;
+	GHashTable *latest;		/* filename -> serial of its newest job */
+	unsigned long serial;
+};
+
+/*
+ * write data to a temporary file next to filename, sync it and rename it
+ * over filename - readers see the old or the new file, never a partial one
+ *
+ * Return: TRUE on success
+ */
+static gboolean write_atomic(const char *filename, GString *data)
+{
+	char *tmp;
+	const char *p;
+	gssize n, left;
+	int fd;
+
+	tmp = strconcat(filename, ".XXXXXX", NULL);
+	if ((fd = g_mkstemp(tmp)) == -1) {
+		print_err("unable to create temporary file for \"%s\": %s\n", filename, strerror(errno));
+		free(tmp);
+		return FALSE;
+	}
+
+	for (p = data->str, left = data->len; left > 0; p += n, left -= n) {
+		if ((n = write(fd, p, left)) == -1) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			print_err("unable to write \"%s\": %s\n", filename, strerror(errno));
+			goto error;
+		}
+	}
+
+	if (fsync(fd) == -1) {
+		print_err("unable to sync \"%s\": %s\n", filename, strerror(errno));
+		goto error;
+	}
+
+	if (close(fd) == -1) {
+		fd = -1;
+		print_err("unable to close \"%s\": %s\n", filename, strerror(errno));
+		goto error;
+	}
+	fd = -1;
+
+	if (g_rename(tmp, filename) == -1) {
+		print_err("unable to replace \"%s\": %s\n", filename, strerror(errno));
+		goto error;
+	}
+
+	free(tmp);
+	return TRUE;
+
+error:
+	if (fd != -1) {
+		close(fd);
+	}
+	g_unlink(tmp);
+	free(tmp);
+	return FALSE;
+}
+
+static void job_free(WriteJob *job)
+{
+	free(job->filename);
+	if (job->data) {
+		g_string_free(job->data, TRUE);
+	}
+	free(job);
+}
+
+static gpointer writer_run(gpointer data)
+{
+	Writer *w = data;
+	WriteJob *job;
+	gboolean stop = FALSE, newest;
+
+	while (!stop) {
+		job = g_async_queue_pop(w->queue);
+
+		switch (job->type) {
+		case JOB_WRITE:
+			/* a newer snapshot of the file is queued - skip this one */
+			g_mutex_lock(&w->lock);
+			newest = GPOINTER_TO_SIZE(g_hash_table_lookup(w->latest, job->filename)) == job->serial;
+			if (newest) {
+				g_hash_table_remove(w->latest, job->filename);
+			}
+			g_mutex_unlock(&w->lock);
+
+			if (newest) {
+				write_atomic(job->filename, job->data);
+			}
+			break;
+		case JOB_STOP:
+			stop = TRUE;
+			break;
+		}
+
+		job_free(job);
+	}
+
+	return NULL;
+}
+
+static void writer_push(Writer *w, int type, const char *filename, GString *data)
+{
+	WriteJob *job = emalloc(sizeof *job);
+
+	job->type = type;
+	job->filename = filename ? strdup(filename) : NULL;
+	job->data = data;
+
+	g_mutex_lock(&w->lock);
+	job->serial = ++w->serial;
+	if (type == JOB_WRITE) {
+		g_hash_table_insert(w->latest, strdup(filename), GSIZE_TO_POINTER(job->serial));
+	}
+	g_mutex_unlock(&w->lock);
+
+	g_async_queue_push(w->queue, job);
+}
+
+Writer *writer_new(void)
+{
+	Writer *w = emalloc(sizeof *w);
+
+	w->queue = g_async_queue_new();
+	g_mutex_init(&w->lock);
+	w->latest = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+	w->serial = 0;
+	w->thread = g_thread_new("writer", writer_run, w);
+
+	return w;
+}
+
+/*
+ * queue data to replace the contents of filename, the writer takes
+ * ownership of data
+ */
+void writer_write(Writer *w, const char *filename, GString *data)
+{
+	writer_push(w, JOB_WRITE, filename, data);
+}
+
+/*
+ * finish the queued writes and stop the thread
+ */
+void writer_free(Writer *w)
+{
+	if (!w) {
+		return;
+	}
+
+	writer_push(w, JOB_STOP, NULL, NULL);
+	g_thread_join(w->thread);
+
+	g_async_queue_unref(w->queue);
+	g_hash_table_destroy(w->latest);
+	g_mutex_clear(&w->lock);
+	free(w);
+}
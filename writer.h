@@ -0,0 +1,15 @@
+#ifndef __WRITER_H__
+#define __WRITER_H__
+
+/*
+ * background file writer: whole-file snapshots are handed to a thread
+ * that replaces each file atomically (temp file, fsync, rename). Only
+ * the newest queued snapshot of a file is written.
+ */
+typedef struct _Writer Writer;
+
+Writer *writer_new(void);
+void writer_write(Writer *w, const char *filename, GString *data);
+void writer_free(Writer *w);
+
+#endif /* __WRITER_H__ */